@@ -1,3 +1,5 @@
 #!/bin/bash
 
 g++ src/*cpp -o bin/ArithmeticCodeCodec -std=c++11
+g++ test/sink_test.cpp src/ac_codec.cpp -o bin/SinkTest -std=c++11
+g++ test/bank_test.cpp src/ac_codec.cpp -o bin/BankTest -std=c++11
@@ -2,13 +2,6 @@
 #include <memory.h>
 #include "ac_codec.h"
 
-const unsigned AC__MinLength = 0x01000000U;   /// Threshold for renormalization.
-const unsigned AC__MaxLength = 0xFFFFFFFFU;   /// Maximum arithmetic coding interval length.
-
-/// Maximum values for general models
-const unsigned DM__LengthShift = 15; /// Length of bits discarded before mult.
-const unsigned DM__MaxCount    = 1 << DM__LengthShift; /// For adaptive models.
-
 static void AC_Error(const char * msg)
 {
     fprintf(stderr, "\n\n -> Arithmetic coding error: ");
@@ -17,6 +10,22 @@ static void AC_Error(const char * msg)
     exit(1);
 }
 
+/// Bits of interval length discarded before multiplication: more for
+/// large alphabets, so every symbol keeps a nonzero probability.
+static unsigned modelLengthShift(unsigned numberOfSymbols)
+{
+    unsigned shift = DM__LengthShift;
+    while (numberOfSymbols > (1U << (shift - 4))) ++shift;
+    return shift;
+}
+
+/// Extra decoder table entries: value / (length >> lengthShift) may exceed
+/// the total count by up to 2^(lengthShift-24) of it.
+static unsigned decoderTableSlack(unsigned tableBits, unsigned lengthShift)
+{
+    return ((1U << tableBits) >> (24 - lengthShift)) + 4;
+}
+
 /// Carry propagation on compressed data buffer.
 inline void ArithmeticCodec::propagateCarry()
 {
@@ -34,6 +43,9 @@ inline void ArithmeticCodec::renormEncryptionInterval()
         base <<= 8;
     }
     while ((length <<= 8) < AC__MinLength); /// Length multiplied by 256.
+
+    /// Keep buffer bounded when bytes go to a sink.
+    if (sink && (unsigned(acPointer - codeBuffer) >= (bufferSize >> 1))) drainEncoder();
 }
 
 inline void ArithmeticCodec::renormDecryptionInterval()
@@ -46,169 +58,106 @@ inline void ArithmeticCodec::renormDecryptionInterval()
     while ((length <<= 8) < AC__MinLength); /// Length multiplied by 256.
 }
 
-void ArithmeticCodec::encode(unsigned data, StaticDataModel & model)
+void ArithmeticCodec::putBits(unsigned data, unsigned numberOfBits)
 {
-    unsigned x, initialBase = base;
+    if ((numberOfBits < 1) || (numberOfBits > 20)) AC_Error("invalid number of bits");
+    if (data >= (1U << numberOfBits)) AC_Error("invalid data bits");
 
-    /// compute products
-    if (data == model.lastSymbol)
-    {
-        x = model.distribution[data] * (length >> DM__LengthShift);
-        base   += x; /// Update interval.
-        length -= x; /// No product needed.
-    }
-    else
-    {
-        x = model.distribution[data] * (length >>= DM__LengthShift);
-        base += x; /// Update interval.
-        length = model.distribution[data+1] * length - x;
-    }
+    unsigned initialBase = base;
+    base += data * (length >>= numberOfBits); /// Update interval.
 
     if (initialBase > base) propagateCarry(); /// overflow = carry
 
     if (length < AC__MinLength) renormEncryptionInterval(); /// Renormalization.
 }
 
-unsigned ArithmeticCodec::decode(StaticDataModel & model)
+unsigned ArithmeticCodec::getBits(unsigned numberOfBits)
 {
-    unsigned n, s, x, y = length;
+    if ((numberOfBits < 1) || (numberOfBits > 20)) AC_Error("invalid number of bits");
 
-    if (model.decoderTable)
-    {
-        /// Use table look-up for faster decoding.
-        unsigned dv = value / (length >>= DM__LengthShift);
-        unsigned t = dv >> model.tableShift;
+    unsigned s = value / (length >>= numberOfBits); /// Decode bits.
+    value -= length * s; /// Update interval.
 
-        /// Initial decision based on table look-up.
-        s = model.decoderTable[t];
-        n = model.decoderTable[t+1] + 1;
+    if (length < AC__MinLength) renormDecryptionInterval(); /// Renormalization.
 
-        while (n > s + 1)
-        {
-            /// Finish with bisection search.
-            unsigned m = (s + n) >> 1;
-            if (model.distribution[m] > dv) n = m;
-            else s = m;
-        }
-        /// Compute products.
-        x = model.distribution[s] * length;
-        if (s != model.lastSymbol) y = model.distribution[s+1] * length;
-    }
-    else
-    {
-        /// Decode using only multiplications.
-        x = s = 0;
-        length >>= DM__LengthShift;
-        unsigned m = (n = model.dataSymbols) >> 1;
-        /// Decode via bisection search.
-        do
-        {
-            unsigned z = length * model.distribution[m];
-            if (z > value)
-            {
-                n = m;
-                y = z;
-            }
-            else
-            {
-                s = m;
-                x = z;
-            }
-        }
-        while ((m = (s + n) >> 1) != s);
-    }
+    return s;
+}
 
-    /// Update interval.
-    value -= x;
-    length = y - x;
+/// Shift is DM__LengthShift, a constant, for models of up to DM__MaxSymbols symbols.
+template <class Model>
+inline void ArithmeticCodec::encodeSymbol(unsigned data, Model & model, unsigned lengthShift)
+{
+    unsigned initialBase = base;
+
+    encodeInterval(data, model, lengthShift, base, length);
+
+    if (initialBase > base) propagateCarry(); /// overflow = carry
+
+    if (length < AC__MinLength) renormEncryptionInterval(); /// Renormalization.
+}
+
+template <class Model>
+inline unsigned ArithmeticCodec::decodeSymbol(Model & model, unsigned lengthShift)
+{
+    unsigned s = decodeInterval(model, lengthShift, value, length);
 
     if (length < AC__MinLength) renormDecryptionInterval(); /// Renormalization.
 
     return s;
 }
 
-void ArithmeticCodec::encode(unsigned data, AdaptiveDataModel & model)
+void ArithmeticCodec::encode(unsigned data, StaticDataModel & model)
 {
-    unsigned x, initialBase = base;
-    /// Compute products.
-    if (data == model.lastSymbol)
-    {
-        x = model.distribution[data] * (length >> DM__LengthShift);
-        base   += x; /// Update interval.
-        length -= x; /// No product needed.
-    }
-    else
-    {
-        x = model.distribution[data] * (length >>= DM__LengthShift);
-        base   += x; /// Update interval.
-        length  = model.distribution[data+1] * length - x;
-    }
+    encodeSymbol(data, model, DM__LengthShift);
+}
 
-    if (initialBase > base) propagateCarry(); /// overflow = carry
+unsigned ArithmeticCodec::decode(StaticDataModel & model)
+{
+    return decodeSymbol(model, DM__LengthShift);
+}
 
-    if (length < AC__MinLength) renormEncryptionInterval(); /// Renormalization.
+void ArithmeticCodec::encode(unsigned data, AdaptiveDataModel & model)
+{
+    encodeSymbol(data, model, DM__LengthShift);
 
-    ++model.symbolCount[data];
-    if (--model.symbolsUntilUpdate == 0) model.update(true);  /// Periodic model update.
+    countSymbol(model, data, true);
 }
 
 unsigned ArithmeticCodec::decode(AdaptiveDataModel & model)
 {
-    unsigned n, s, x, y = length;
+    unsigned s = decodeSymbol(model, DM__LengthShift);
 
-    if (model.decoderTable)
-    {
-        /// Use table look-up for faster decoding.
-        unsigned dv = value / (length >>= DM__LengthShift);
-        unsigned t = dv >> model.tableShift;
+    countSymbol(model, s, false);
+
+    return s;
+}
 
-        /// Initial decision based on table look-up.
-        s = model.decoderTable[t];
-        n = model.decoderTable[t+1] + 1;
+void ArithmeticCodec::encode(unsigned data, LargeStaticDataModel & large)
+{
+    StaticDataModel & model = large;
+    encodeSymbol(data, model, model.lengthShift);
+}
 
-        /// Finish with bisection search.
-        while (n > s + 1)
-        {
-            unsigned m = (s + n) >> 1;
-            if (model.distribution[m] > dv) n = m;
-            else s = m;
-        }
-        /// Compute products.
-        x = model.distribution[s] * length;
-        if (s != model.lastSymbol) y = model.distribution[s+1] * length;
-    }
-    else
-    {
-        /// Decode using only multiplications.
-        x = s = 0;
-        length >>= DM__LengthShift;
-        unsigned m = (n = model.dataSymbols) >> 1;
+unsigned ArithmeticCodec::decode(LargeStaticDataModel & large)
+{
+    StaticDataModel & model = large;
+    return decodeSymbol(model, model.lengthShift);
+}
 
-        /// Decode via bisection search.
-        do
-        {
-            unsigned z = length * model.distribution[m];
-            if (z > value)
-            {
-                n = m;
-                y = z;
-            }
-            else
-            {
-                s = m;
-                x = z;
-            }
-        }
-        while ((m = (s + n) >> 1) != s);
-    }
+void ArithmeticCodec::encode(unsigned data, LargeAdaptiveDataModel & large)
+{
+    AdaptiveDataModel & model = large;
+    encodeSymbol(data, model, model.lengthShift);
 
-    value -= x; /// Update interval
-    length = y - x;
+    countSymbol(model, data, true);
+}
 
-    if (length < AC__MinLength) renormDecryptionInterval(); /// Renormalization.
+unsigned ArithmeticCodec::decode(LargeAdaptiveDataModel & large)
+{
+    AdaptiveDataModel & model = large;
+    unsigned s = decodeSymbol(model, model.lengthShift);
 
-    ++model.symbolCount[s];
-    if (--model.symbolsUntilUpdate == 0) model.update(false);  /// Periodic model update.
+    countSymbol(model, s, false);
 
     return s;
 }
@@ -217,12 +166,14 @@ ArithmeticCodec::ArithmeticCodec()
 {
     mode = bufferSize = 0;
     newBuffer = codeBuffer = 0;
+    sink = 0;
 }
 
 ArithmeticCodec::ArithmeticCodec(unsigned maxEncodedBytes, unsigned char * userBuffer)
 {
     mode = bufferSize = 0;
     newBuffer = codeBuffer = 0;
+    sink = 0;
     setBuffer(maxEncodedBytes, userBuffer);
 }
 
@@ -269,6 +220,69 @@ void ArithmeticCodec::startEncoder()
     acPointer = codeBuffer; /// Pointer to next data byte.
 }
 
+void ArithmeticCodec::startEncoder(ByteSink byteSink, void * byteSinkData)
+{
+    startEncoder();
+    sink = byteSink;
+    sinkData = byteSinkData;
+    sentBytes = 0;
+}
+
+unsigned ArithmeticCodec::drainEncoder()
+{
+    if (mode != 1) AC_Error("invalid to drain encoder");
+    if (sink == 0) return 0;
+
+    /// A carry changes only the last byte that is not 0xFF, and the ones after it.
+    unsigned char * p = acPointer;
+    do
+    {
+        if (p == codeBuffer) return 0;
+    }
+    while (*--p == 0xFFU);
+
+    unsigned settledBytes = unsigned(p - codeBuffer);
+    if (settledBytes == 0) return 0;
+
+    sink(codeBuffer, settledBytes, sinkData);
+    memmove(codeBuffer, p, acPointer - p); /// Keep bytes that may change.
+    acPointer -= settledBytes;
+    sentBytes += settledBytes;
+    return settledBytes;
+}
+
+void ArithmeticCodec::flushEncoder()
+{
+    if (mode != 1) AC_Error("invalid to flush encoder");
+
+    terminateCode(); /// No carry can reach the bytes of a finished segment.
+    if (sink)
+    {
+        unsigned codeBytes = unsigned(acPointer - codeBuffer);
+        if (codeBytes > bufferSize) AC_Error("code buffer overflow");
+        sink(codeBuffer, codeBytes, sinkData);
+        sentBytes += codeBytes;
+        acPointer = codeBuffer;
+    }
+
+    /// Start new segment.
+    base   = 0;
+    length = AC__MaxLength;
+}
+
+void ArithmeticCodec::flushDecoder()
+{
+    if (mode != 2) AC_Error("invalid to flush decoder");
+
+    /// The decoder reads 3 bytes ahead; the encoder ended the segment with 1 or 2 bytes.
+    acPointer -= (length > 2 * AC__MinLength ? 2 : 1);
+
+    length = AC__MaxLength;
+    value = ((unsigned)(acPointer[0]) << 24) | ((unsigned)(acPointer[1]) << 16) |
+            ((unsigned)(acPointer[2]) <<  8) | (unsigned)(acPointer[3]);
+    acPointer += 3;
+}
+
 void ArithmeticCodec::startDecoder()
 {
     if (mode != 0) AC_Error("cannot start decoder");
@@ -325,11 +339,27 @@ void ArithmeticCodec::readFromFile(FILE * encodedFile)
     startDecoder(); /// Initialize decoder.
 }
 
-unsigned ArithmeticCodec::stopEncoder()
+void ArithmeticCodec::skipInFile(FILE * encodedFile)
 {
-    if (mode != 1) AC_Error("invalid to stop encoder");
-    mode = 0;
+    unsigned shift = 0, codeBytes = 0;
+    int fileByte;
 
+    /// Read variable-length header with number of code bytes.
+    do
+    {
+        if ((fileByte = getc(encodedFile)) == EOF)
+            AC_Error("cannot read code from file");
+        codeBytes |= unsigned(fileByte & 0x7F) << shift;
+        shift += 7;
+    }
+    while (fileByte & 0x80);
+
+    if (fseek(encodedFile, long(codeBytes), SEEK_CUR) != 0)
+        AC_Error("cannot read code from file");
+}
+
+void ArithmeticCodec::terminateCode()
+{
     /// Done encoding: set final data bytes
     unsigned initialBase = base;
 
@@ -347,15 +377,31 @@ unsigned ArithmeticCodec::stopEncoder()
     if (initialBase > base) propagateCarry(); /// overflow = carry
 
     renormEncryptionInterval(); /// Renormalization = output last bytes.
+}
+
+unsigned ArithmeticCodec::stopEncoder()
+{
+    if (mode != 1) AC_Error("invalid to stop encoder");
+
+    terminateCode();
+    mode = 0;
 
     unsigned codeBytes = unsigned(acPointer - codeBuffer);
     if (codeBytes > bufferSize) AC_Error("code buffer overflow");
 
+    if (sink)
+    {
+        sink(codeBuffer, codeBytes, sinkData);
+        codeBytes += sentBytes;
+        sink = 0;
+    }
+
     return codeBytes; /// Number of bytes used.
 }
 
 unsigned ArithmeticCodec::writeToOutputBuffer(unsigned char* buffer, int offset)
 {
+    if (sink) AC_Error("encoded data already sent to sink");
     unsigned headerBytes = 0, codeBytes = stopEncoder(), nb = codeBytes;
 
     /// Write variable-length header with number of code bytes.
@@ -374,6 +420,7 @@ unsigned ArithmeticCodec::writeToOutputBuffer(unsigned char* buffer, int offset)
 
 unsigned ArithmeticCodec::writeToFile(FILE * encodedFile)
 {
+    if (sink) AC_Error("encoded data already sent to sink");
     unsigned headerBytes = 0, codeBytes = stopEncoder(), nb = codeBytes;
 
     /// Write variable-length header with number of code bytes.
@@ -402,6 +449,7 @@ void ArithmeticCodec::stopDecoder()
 
 StaticDataModel::StaticDataModel()
 {
+    maxSymbols = DM__MaxSymbols;
     dataSymbols = 0;
     distribution = 0;
 }
@@ -411,9 +459,9 @@ StaticDataModel::~StaticDataModel()
     delete [] distribution;
 }
 
-void StaticDataModel::setDistribution(unsigned numberOfSymbols, const double probability[])
+void StaticDataModel::setSymbols(unsigned numberOfSymbols)
 {
-    if ((numberOfSymbols < 2) || (numberOfSymbols > (1 << 11)))
+    if ((numberOfSymbols < 2) || (numberOfSymbols > maxSymbols))
         AC_Error("invalid number of data symbols");
 
     /// Assign memory for data model.
@@ -421,14 +469,15 @@ void StaticDataModel::setDistribution(unsigned numberOfSymbols, const double pro
     {
         dataSymbols = numberOfSymbols;
         lastSymbol = dataSymbols - 1;
+        lengthShift = modelLengthShift(dataSymbols);
         delete [] distribution;
         /// Define size of table for fast decoding.
         if (dataSymbols > 16)
         {
             unsigned tableBits = 3;
             while (dataSymbols > (1U << (tableBits + 2))) ++tableBits;
-            tableSize  = (1 << tableBits) + 4;
-            tableShift = DM__LengthShift - tableBits;
+            tableSize  = (1 << tableBits) + decoderTableSlack(tableBits, lengthShift);
+            tableShift = lengthShift - tableBits;
             distribution = new unsigned[dataSymbols+tableSize+6];
             decoderTable = distribution + dataSymbols;
         }
@@ -441,6 +490,12 @@ void StaticDataModel::setDistribution(unsigned numberOfSymbols, const double pro
         }
         if (distribution == 0) AC_Error("cannot assign model memory");
     }
+}
+
+void StaticDataModel::setDistribution(unsigned numberOfSymbols, const double probability[])
+{
+    setSymbols(numberOfSymbols);
+
     /// Compute cumulative distribution, decoder table.
     unsigned s = 0;
     double sum = 0.0, p = 1.0 / double(dataSymbols);
@@ -448,8 +503,8 @@ void StaticDataModel::setDistribution(unsigned numberOfSymbols, const double pro
     for (unsigned k = 0; k < dataSymbols; k++)
     {
         if (probability) p = probability[k];
-        if ((p < 0.0001) || (p > 0.9999)) AC_Error("invalid symbol probability");
-        distribution[k] = unsigned(sum * (1 << DM__LengthShift));
+        if ((p * (1 << lengthShift) < 2.0) || (p > 0.9999)) AC_Error("invalid symbol probability");
+        distribution[k] = unsigned(sum * (1 << lengthShift));
         sum += p;
         if (tableSize == 0) continue;
         unsigned w = distribution[k] >> tableShift;
@@ -465,14 +520,43 @@ void StaticDataModel::setDistribution(unsigned numberOfSymbols, const double pro
     if ((sum < 0.9999) || (sum > 1.0001)) AC_Error("invalid probabilities");
 }
 
+void StaticDataModel::setFrequencies(unsigned numberOfSymbols, const unsigned frequency[])
+{
+    setSymbols(numberOfSymbols);
+
+    unsigned total = 0;
+    for (unsigned k = 0; k < dataSymbols; k++)
+        if ((total += frequency[k]) > (1U << lengthShift)) AC_Error("invalid symbol frequencies");
+    if (total == 0) AC_Error("invalid symbol frequencies");
+
+    /// Compute cumulative distribution, decoder table.
+    unsigned s = 0, sum = 0;
+    for (unsigned k = 0; k < dataSymbols; k++)
+    {
+        distribution[k] = unsigned((((unsigned long long)sum) << lengthShift) / total);
+        sum += frequency[k];
+        if (tableSize == 0) continue;
+        unsigned w = distribution[k] >> tableShift;
+        while (s < w) decoderTable[++s] = k - 1;
+    }
+
+    if (tableSize != 0)
+    {
+        decoderTable[0] = 0;
+        while (s <= tableSize) decoderTable[++s] = dataSymbols - 1;
+    }
+}
+
 AdaptiveDataModel::AdaptiveDataModel()
 {
+    maxSymbols = DM__MaxSymbols;
     dataSymbols = 0;
     distribution = 0;
 }
 
 AdaptiveDataModel::AdaptiveDataModel(unsigned numberOfSymbols)
 {
+    maxSymbols = DM__MaxSymbols;
     dataSymbols = 0;
     distribution = 0;
     setAlphabet(numberOfSymbols);
@@ -485,7 +569,7 @@ AdaptiveDataModel::~AdaptiveDataModel()
 
 void AdaptiveDataModel::setAlphabet(unsigned numberOfSymbols)
 {
-    if ((numberOfSymbols < 2) || (numberOfSymbols > (1 << 11)))
+    if ((numberOfSymbols < 2) || (numberOfSymbols > maxSymbols))
         AC_Error("invalid number of data symbols");
 
     /// Assign memory for data model.
@@ -493,14 +577,15 @@ void AdaptiveDataModel::setAlphabet(unsigned numberOfSymbols)
     {
         dataSymbols = numberOfSymbols;
         lastSymbol = dataSymbols - 1;
+        lengthShift = modelLengthShift(dataSymbols);
         delete [] distribution;
         /// Define size of table for fast decoding
         if (dataSymbols > 16)
         {
             unsigned tableBits = 3;
             while (dataSymbols > (1U << (tableBits + 2))) ++tableBits;
-            tableSize  = (1 << tableBits) + 4;
-            tableShift = DM__LengthShift - tableBits;
+            tableSize  = (1 << tableBits) + decoderTableSlack(tableBits, lengthShift);
+            tableShift = lengthShift - tableBits;
             distribution = new unsigned[2*dataSymbols+tableSize+6];
             decoderTable = distribution + 2 * dataSymbols;
         }
@@ -517,10 +602,22 @@ void AdaptiveDataModel::setAlphabet(unsigned numberOfSymbols)
     reset(); /// Initialize model.
 }
 
+unsigned AdaptiveDataModel::memoryBytes(unsigned numberOfSymbols)
+{
+    unsigned tableSize = 0;
+    if (numberOfSymbols > 16)
+    {
+        unsigned tableBits = 3;
+        while (numberOfSymbols > (1U << (tableBits + 2))) ++tableBits;
+        tableSize = (1 << tableBits) + decoderTableSlack(tableBits, modelLengthShift(numberOfSymbols)) + 6;
+    }
+    return sizeof(AdaptiveDataModel) + sizeof(unsigned) * (2 * numberOfSymbols + tableSize);
+}
+
 void AdaptiveDataModel::update(bool from_encoder)
 {
     /// Halve counts when a threshold is reached.
-    if ((totalCount += updateCycle) > DM__MaxCount)
+    if ((totalCount += updateCycle) > (1U << lengthShift))
     {
         totalCount = 0;
         for (unsigned n = 0; n < dataSymbols; n++)
@@ -534,14 +631,14 @@ void AdaptiveDataModel::update(bool from_encoder)
     if (from_encoder || (tableSize == 0))
         for (k = 0; k < dataSymbols; k++)
         {
-            distribution[k] = (scale * sum) >> (31 - DM__LengthShift);
+            distribution[k] = (scale * sum) >> (31 - lengthShift);
             sum += symbolCount[k];
         }
     else
     {
         for (k = 0; k < dataSymbols; k++)
         {
-            distribution[k] = (scale * sum) >> (31 - DM__LengthShift);
+            distribution[k] = (scale * sum) >> (31 - lengthShift);
             sum += symbolCount[k];
             unsigned w = distribution[k] >> tableShift;
             while (s < w) decoderTable[++s] = k - 1;
@@ -552,6 +649,7 @@ void AdaptiveDataModel::update(bool from_encoder)
     /// Set frequency of model updates.
     updateCycle = (5 * updateCycle) >> 2;
     unsigned max_cycle = (dataSymbols + 6) << 3;
+    if (max_cycle > DM__MaxUpdateCycle) max_cycle = DM__MaxUpdateCycle;
     if (updateCycle > max_cycle) updateCycle = max_cycle;
     symbolsUntilUpdate = updateCycle;
 }
@@ -565,5 +663,208 @@ void AdaptiveDataModel::reset()
     updateCycle = dataSymbols;
     for (unsigned k = 0; k < dataSymbols; k++) symbolCount[k] = 1;
     update(false);
-    symbolsUntilUpdate = updateCycle = (dataSymbols + 6) >> 1;
+    updateCycle = (dataSymbols + 6) >> 1;
+    if (updateCycle > DM__MaxFirstUpdate) updateCycle = DM__MaxFirstUpdate;
+    symbolsUntilUpdate = updateCycle;
+}
+
+ModelBank::ModelBank()
+{
+    table = 0;
+    pool = 0;
+    owner = 0;
+    used = 0;
+    directIndex = true;
+    budgeted = false;
+    numContexts = numSymbols = maxModels = usedModels = allocatedModels = nextVictim = 0;
+    poolSize = tableSize = tableMask = hashShift = 0;
+}
+
+ModelBank::ModelBank(unsigned numberOfContexts, unsigned numberOfSymbols, unsigned memoryBudget)
+{
+    table = 0;
+    pool = 0;
+    owner = 0;
+    used = 0;
+    directIndex = true;
+    budgeted = false;
+    numContexts = numSymbols = maxModels = usedModels = allocatedModels = nextVictim = 0;
+    poolSize = tableSize = tableMask = hashShift = 0;
+    setContexts(numberOfContexts, numberOfSymbols, memoryBudget);
+}
+
+ModelBank::~ModelBank()
+{
+    release();
+}
+
+void ModelBank::release()
+{
+    for (unsigned k = 0; k < poolSize; k++) delete pool[k];
+    delete [] table;
+    delete [] pool;
+    delete [] owner;
+    delete [] used;
+    table = 0;
+    pool = 0;
+    owner = 0;
+    used = 0;
+    poolSize = tableSize = 0;
+}
+
+/// Pool bytes for each model: pool, owner and used entries.
+static const unsigned modelPoolBytes = sizeof(AdaptiveDataModel *) + sizeof(unsigned) + 1;
+
+void ModelBank::setContexts(unsigned numberOfContexts, unsigned numberOfSymbols, unsigned memoryBudget)
+{
+    if (numberOfContexts == 0) AC_Error("invalid number of contexts");
+    if ((numberOfSymbols < 2) || (numberOfSymbols > DM__MaxSymbols))
+        AC_Error("invalid number of data symbols");
+
+    /// Number of models that fit in the budget. A direct table has one entry per context;
+    /// a hash table has up to 4 entries per model.
+    bool direct = (numberOfContexts <= MB__MaxDirectContexts);
+    unsigned models = numberOfContexts;
+    if (memoryBudget != 0)
+    {
+        unsigned fixedBytes = sizeof(ModelBank) + (direct ? numberOfContexts * sizeof(Entry) : 0);
+        unsigned modelBytes = AdaptiveDataModel::memoryBytes(numberOfSymbols) + modelPoolBytes +
+                              (direct ? 0 : 4 * sizeof(Entry));
+        if (memoryBudget < fixedBytes + modelBytes) AC_Error("memory budget too small for context models");
+        if ((memoryBudget - fixedBytes) / modelBytes < models) models = (memoryBudget - fixedBytes) / modelBytes;
+    }
+
+    release();
+    directIndex = direct;
+    budgeted = (models < numberOfContexts);
+    numContexts = numberOfContexts;
+    numSymbols = numberOfSymbols;
+    maxModels = models;
+    usedModels = allocatedModels = nextVictim = 0;
+    if (directIndex)
+    {
+        table = new Entry[numContexts];
+        tableSize = numContexts;
+        for (unsigned h = 0; h < tableSize; h++) table[h].model = 0;
+    }
+    setPoolSize(maxModels < 16 ? maxModels : 16);
+}
+
+void ModelBank::setPoolSize(unsigned models)
+{
+    AdaptiveDataModel ** newPool = new AdaptiveDataModel * [models];
+    unsigned * newOwner = new unsigned[models];
+    unsigned char * newUsed = new unsigned char[models];
+    for (unsigned k = 0; k < models; k++) newPool[k] = (k < poolSize ? pool[k] : 0);
+    if (usedModels)
+    {
+        memcpy(newOwner, owner, usedModels * sizeof(unsigned));
+        memcpy(newUsed, used, usedModels);
+    }
+    delete [] pool;
+    delete [] owner;
+    delete [] used;
+    pool = newPool;
+    owner = newOwner;
+    used = newUsed;
+    poolSize = models;
+    if (directIndex) return; /// Direct entries point to the models, which do not move.
+
+    /// Hash table is at most half full.
+    delete [] table;
+    for (tableSize = 4; tableSize < 2 * models; tableSize <<= 1);
+    table = new Entry[tableSize];
+    tableMask = tableSize - 1;
+    for (hashShift = 32; (1U << (32 - hashShift)) < tableSize; hashShift--);
+    for (unsigned h = 0; h < tableSize; h++) table[h].model = 0;
+    for (unsigned k = 0; k < usedModels; k++) insert(k);
+}
+
+void ModelBank::insert(unsigned k)
+{
+    unsigned h = owner[k];
+    if (!directIndex)
+    {
+        h = (owner[k] * 0x9E3779B1U) >> hashShift;
+        while (table[h].model) h = (h + 1) & tableMask;
+    }
+    table[h].model = pool[k];
+    table[h].context = owner[k];
+    table[h].index = k;
+}
+
+void ModelBank::remove(unsigned context)
+{
+    if (directIndex)
+    {
+        table[context].model = 0;
+        return;
+    }
+
+    unsigned h = (context * 0x9E3779B1U) >> hashShift;
+    while (table[h].context != context) h = (h + 1) & tableMask;
+
+    /// Move back later entries of the probe sequence, so none is cut off by the empty entry.
+    for (unsigned j = h;;)
+    {
+        j = (j + 1) & tableMask;
+        if (table[j].model == 0) break;
+        unsigned home = (table[j].context * 0x9E3779B1U) >> hashShift;
+        if (((j - home) & tableMask) >= ((j - h) & tableMask))
+        {
+            table[h] = table[j];
+            h = j;
+        }
+    }
+    table[h].model = 0;
+}
+
+void ModelBank::reset()
+{
+    /// Models stay assigned, and are reset when taken again from the pool.
+    for (unsigned h = 0; h < tableSize; h++) table[h].model = 0;
+    usedModels = nextVictim = 0;
+}
+
+AdaptiveDataModel & ModelBank::newModel(unsigned context)
+{
+    if (table == 0) AC_Error("context models not set");
+    if (context >= numContexts) AC_Error("invalid model context");
+
+    unsigned k;
+    if (usedModels < maxModels)
+    {
+        if (usedModels == poolSize) setPoolSize(4 * poolSize < maxModels ? 4 * poolSize : maxModels);
+        k = usedModels++;
+    }
+    else
+    {
+        /// Budget reached: recycle the first model not used since the hand last passed it.
+        while (used[nextVictim])
+        {
+            used[nextVictim] = 0;
+            if (++nextVictim == maxModels) nextVictim = 0;
+        }
+        k = nextVictim;
+        if (++nextVictim == maxModels) nextVictim = 0;
+        remove(owner[k]);
+    }
+
+    if (pool[k] == 0)
+    {
+        pool[k] = new AdaptiveDataModel(numSymbols);
+        ++allocatedModels;
+    }
+    else pool[k]->reset();
+
+    owner[k] = context;
+    used[k] = 0;
+    insert(k);
+    return *pool[k];
+}
+
+unsigned ModelBank::memoryUsage()
+{
+    return sizeof(ModelBank) + poolSize * modelPoolBytes + tableSize * sizeof(Entry) +
+           allocatedModels * AdaptiveDataModel::memoryBytes(numSymbols);
 }
@@ -3,6 +3,20 @@
 
 #include <stdio.h>
 
+const unsigned AC__MinLength = 0x01000000U;   /// Threshold for renormalization.
+const unsigned AC__MaxLength = 0xFFFFFFFFU;   /// Maximum arithmetic coding interval length.
+
+/// Maximum values for general models
+const unsigned DM__LengthShift    = 15; /// Length of bits discarded before mult. (up to 2048 symbols)
+const unsigned DM__MaxSymbols     = 1 << 11;
+const unsigned DM__MaxLargeSymbols = 1 << 16; /// Large models: more bits discarded.
+const unsigned DM__MaxUpdateCycle = 1 << 15; /// Bound on adaptive model update period.
+const unsigned DM__MaxFirstUpdate = 1 << 11;
+const unsigned MB__MaxDirectContexts = 1 << 12; /// Model bank: larger context spaces are hashed.
+
+/// Receives encoded bytes that can no longer change.
+typedef void (*ByteSink)(const unsigned char * bytes, unsigned count, void * sinkData);
+
 /// Static model for general data.
 class StaticDataModel
 {
@@ -11,10 +25,26 @@ class StaticDataModel
         ~StaticDataModel(void);
         unsigned modelSymbols(void) { return dataSymbols; }
         void setDistribution(unsigned numberOfSymbols, const double probability[] = 0); /// 0 means uniform
+        void setFrequencies(unsigned numberOfSymbols, const unsigned frequency[]); /// Zero for unused symbols.
+
+    protected:
+        unsigned maxSymbols;
 
     private:
+        void setSymbols(unsigned numberOfSymbols);
         unsigned * distribution, * decoderTable;
-        unsigned dataSymbols, lastSymbol, tableSize, tableShift;
+        unsigned dataSymbols, lastSymbol, tableSize, tableShift, lengthShift;
+        friend class ArithmeticCodec;
+};
+
+/// Static model for alphabets of more than DM__MaxSymbols symbols.
+class LargeStaticDataModel : private StaticDataModel
+{
+    public:
+        LargeStaticDataModel(void) { maxSymbols = DM__MaxLargeSymbols; }
+        using StaticDataModel::modelSymbols;
+        using StaticDataModel::setDistribution;
+        using StaticDataModel::setFrequencies;
         friend class ArithmeticCodec;
 };
 
@@ -28,15 +58,92 @@ class AdaptiveDataModel
         unsigned modelSymbols(void) { return dataSymbols; }
         void reset(void); /// Reset to equiprobable model.
         void setAlphabet(unsigned numberOfSymbols);
+        static unsigned memoryBytes(unsigned numberOfSymbols); /// Memory used by a model of this alphabet.
+
+    protected:
+        unsigned maxSymbols;
 
     private:
         void update(bool);
         unsigned * distribution, * symbolCount, * decoderTable;
         unsigned totalCount, updateCycle, symbolsUntilUpdate;
-        unsigned dataSymbols, lastSymbol, tableSize, tableShift;
+        unsigned dataSymbols, lastSymbol, tableSize, tableShift, lengthShift;
+        friend class ArithmeticCodec;
+};
+
+/// Adaptive model for alphabets of more than DM__MaxSymbols symbols.
+class LargeAdaptiveDataModel : private AdaptiveDataModel
+{
+    public:
+        LargeAdaptiveDataModel(void) { maxSymbols = DM__MaxLargeSymbols; }
+        LargeAdaptiveDataModel(unsigned numberOfSymbols)
+        {
+            maxSymbols = DM__MaxLargeSymbols;
+            setAlphabet(numberOfSymbols);
+        }
+        using AdaptiveDataModel::modelSymbols;
+        using AdaptiveDataModel::reset;
+        using AdaptiveDataModel::setAlphabet;
+        using AdaptiveDataModel::memoryBytes;
         friend class ArithmeticCodec;
 };
 
+/// Adaptive context models, each one created on first use of its context.
+/// Up to MB__MaxDirectContexts contexts are indexed directly; larger context spaces
+/// use a hash table sized by the number of models, not of contexts.
+/// With a memory budget a model not used since the last eviction pass is recycled
+/// (second chance), so encoder and decoder evict in the same order.
+class ModelBank
+{
+    public:
+        ModelBank(void);
+        ModelBank(unsigned numberOfContexts, unsigned numberOfSymbols, unsigned memoryBudget = 0); /// 0 -> no budget
+        ~ModelBank(void);
+        void setContexts(unsigned numberOfContexts, unsigned numberOfSymbols, unsigned memoryBudget = 0);
+        void reset(void); /// Start again with no context models.
+        unsigned contexts(void) { return numContexts; }
+        unsigned activeModels(void) { return usedModels; }
+        unsigned memoryUsage(void); /// Bytes currently assigned.
+
+        AdaptiveDataModel & operator[](unsigned context)
+        {
+            Entry * entry;
+            if (directIndex)
+            {
+                if ((context >= numContexts) || (table[context].model == 0)) return newModel(context);
+                entry = table + context;
+            }
+            else
+            {
+                unsigned h = (context * 0x9E3779B1U) >> hashShift;
+                while (table[h].model && (table[h].context != context)) h = (h + 1) & tableMask;
+                if (table[h].model == 0) return newModel(context);
+                entry = table + h;
+            }
+            if (budgeted) used[entry->index] = 1;
+            return *entry->model;
+        }
+
+    private:
+        struct Entry /// Context and its model, indexed by context or hashed with linear probing.
+        {
+            AdaptiveDataModel * model; /// 0 -> empty entry.
+            unsigned context, index;
+        };
+        AdaptiveDataModel & newModel(unsigned context);
+        void setPoolSize(unsigned models);
+        void insert(unsigned k);
+        void remove(unsigned context);
+        void release(void);
+        Entry * table;
+        AdaptiveDataModel ** pool;
+        unsigned * owner; /// Context of each model in pool.
+        unsigned char * used; /// Second-chance bit of each model; set only with a budget.
+        bool directIndex, budgeted;
+        unsigned numContexts, numSymbols, maxModels, usedModels, allocatedModels, nextVictim;
+        unsigned poolSize, tableSize, tableMask, hashShift;
+};
+
 /// Class with both the arithmetic encoder and decoder.
 /// All compressed data is saved to a memory buffer.
 class ArithmeticCodec
@@ -50,29 +157,226 @@ class ArithmeticCodec
         void     setBuffer(unsigned maxEncodedBytes, unsigned char * userBuffer = 0); /// 0 -> assign new
 
         void     startEncoder(void);
+        void     startEncoder(ByteSink sink, void * sinkData = 0); /// Encoded bytes go to sink, not to file.
         void     startDecoder(void);
 
+        unsigned drainEncoder(void); /// Send settled bytes to sink. Returns number of bytes sent.
+        void     flushEncoder(void); /// End code segment and send all its bytes; models are kept.
+        void     flushDecoder(void); /// Move to the code segment after a flushEncoder point.
+
         void     readFromFile(FILE * encodedFile); /// Read encoded data and then start decoder.
+        void     skipInFile(FILE * encodedFile); /// Move past encoded data without reading it.
         unsigned readFromInputBuffer(unsigned char* buffer, int offset);
-        unsigned stopEncoder(void); /// Returns number of bytes used.
+        unsigned stopEncoder(void); /// Returns number of bytes used (with a sink, all bytes sent).
 
         unsigned writeToFile(FILE * encodedFile); /// Stop encoder and then write encoded data.
         unsigned writeToOutputBuffer(unsigned char* buffer, int offset);
         void     stopDecoder(void);
 
+        void     putBits(unsigned data, unsigned numberOfBits); /// 1 to 20 bits, without model.
+        unsigned getBits(unsigned numberOfBits);
+
         void     encode(unsigned data, StaticDataModel &);
         unsigned decode(StaticDataModel &);
 
         void     encode(unsigned data, AdaptiveDataModel &);
         unsigned decode(AdaptiveDataModel &);
 
+        void     encode(unsigned data, LargeStaticDataModel &);
+        unsigned decode(LargeStaticDataModel &);
+
+        void     encode(unsigned data, LargeAdaptiveDataModel &);
+        unsigned decode(LargeAdaptiveDataModel &);
+
+        /// Code a block of bytes with context models (ModelBank, or array of StaticDataModel).
+        /// Coder state is kept in local variables; nextContext(context, symbol) gives the
+        /// context of the next byte. Pass a function object, not a function pointer, so the
+        /// call is inlined.
+        template <class ModelSet, class ContextFunction>
+        void     encodeBlock(const unsigned char * data, unsigned count, ModelSet & models, unsigned & context, ContextFunction nextContext);
+        template <class ModelSet, class ContextFunction>
+        void     decodeBlock(unsigned char * data, unsigned count, ModelSet & models, unsigned & context, ContextFunction nextContext);
+
     private:
+        template <class Model> void     encodeSymbol(unsigned data, Model & model, unsigned lengthShift);
+        template <class Model> unsigned decodeSymbol(Model & model, unsigned lengthShift);
+        /// Interval of one symbol, shared by the calls above and the block kernels.
+        template <class Model>
+        static void     encodeInterval(unsigned data, Model & model, unsigned lengthShift, unsigned & base, unsigned & length);
+        template <class Model>
+        static unsigned decodeInterval(Model & model, unsigned lengthShift, unsigned & value, unsigned & length);
+        static void countSymbol(StaticDataModel &, unsigned, bool) { }
+        static void countSymbol(AdaptiveDataModel & model, unsigned data, bool fromEncoder)
+        {
+            ++model.symbolCount[data];
+            if (--model.symbolsUntilUpdate == 0) model.update(fromEncoder); /// Periodic model update.
+        }
         void propagateCarry(void);
         void renormEncryptionInterval(void);
         void renormDecryptionInterval(void);
+        void terminateCode(void);
         unsigned char * codeBuffer, * newBuffer, * acPointer;
         unsigned base, value, length; /// Arithmetic coding state.
         unsigned bufferSize, mode; /// Mode: 0 = undefined, 1 = encoder, 2 = decoder.
+        ByteSink sink; /// 0 -> keep code in buffer.
+        void * sinkData;
+        unsigned sentBytes;
 };
 
+template <class Model>
+inline void ArithmeticCodec::encodeInterval(unsigned data, Model & model, unsigned lengthShift, unsigned & base, unsigned & length)
+{
+    unsigned x;
+
+    /// compute products
+    if (data == model.lastSymbol)
+    {
+        x = model.distribution[data] * (length >> lengthShift);
+        base   += x; /// Update interval.
+        length -= x; /// No product needed.
+    }
+    else
+    {
+        x = model.distribution[data] * (length >>= lengthShift);
+        base += x; /// Update interval.
+        length = model.distribution[data+1] * length - x;
+    }
+}
+
+template <class Model>
+inline unsigned ArithmeticCodec::decodeInterval(Model & model, unsigned lengthShift, unsigned & value, unsigned & length)
+{
+    unsigned n, s, x, y = length;
+
+    if (model.decoderTable)
+    {
+        /// Use table look-up for faster decoding.
+        unsigned dv = value / (length >>= lengthShift);
+        unsigned t = dv >> model.tableShift;
+
+        /// Initial decision based on table look-up.
+        s = model.decoderTable[t];
+        n = model.decoderTable[t+1] + 1;
+
+        while (n > s + 1)
+        {
+            /// Finish with bisection search.
+            unsigned m = (s + n) >> 1;
+            if (model.distribution[m] > dv) n = m;
+            else s = m;
+        }
+        /// Compute products.
+        x = model.distribution[s] * length;
+        if (s != model.lastSymbol) y = model.distribution[s+1] * length;
+    }
+    else
+    {
+        /// Decode using only multiplications.
+        x = s = 0;
+        length >>= lengthShift;
+        unsigned m = (n = model.dataSymbols) >> 1;
+        /// Decode via bisection search.
+        do
+        {
+            unsigned z = length * model.distribution[m];
+            if (z > value)
+            {
+                n = m;
+                y = z;
+            }
+            else
+            {
+                s = m;
+                x = z;
+            }
+        }
+        while ((m = (s + n) >> 1) != s);
+    }
+
+    /// Update interval.
+    value -= x;
+    length = y - x;
+
+    return s;
+}
+
+template <class ModelSet, class ContextFunction>
+void ArithmeticCodec::encodeBlock(const unsigned char * data, unsigned count, ModelSet & models, unsigned & context, ContextFunction nextContext)
+{
+    unsigned b = base, l = length, c = context;
+    unsigned char * p = acPointer;
+
+    for (unsigned k = 0; k < count; k++)
+    {
+        unsigned s = data[k], initialBase = b;
+        auto & model = models[c];
+
+        encodeInterval(s, model, DM__LengthShift, b, l);
+
+        if (initialBase > b) /// overflow = carry
+        {
+            unsigned char * q;
+            for (q = p - 1; *q == 0xFFU; q--) *q = 0;
+            ++*q;
+        }
+
+        if (l < AC__MinLength) /// Renormalization.
+        {
+            do
+            {
+                *p++ = (unsigned char)(b >> 24);
+                b <<= 8;
+            }
+            while ((l <<= 8) < AC__MinLength);
+
+            if (sink && (unsigned(p - codeBuffer) >= (bufferSize >> 1)))
+            {
+                acPointer = p;
+                drainEncoder();
+                p = acPointer;
+            }
+        }
+
+        countSymbol(model, s, true);
+
+        c = nextContext(c, s);
+    }
+
+    base = b;
+    length = l;
+    acPointer = p;
+    context = c;
+}
+
+template <class ModelSet, class ContextFunction>
+void ArithmeticCodec::decodeBlock(unsigned char * data, unsigned count, ModelSet & models, unsigned & context, ContextFunction nextContext)
+{
+    unsigned v = value, l = length, c = context;
+    unsigned char * p = acPointer;
+
+    for (unsigned k = 0; k < count; k++)
+    {
+        auto & model = models[c];
+
+        unsigned s = decodeInterval(model, DM__LengthShift, v, l);
+
+        if (l < AC__MinLength) /// Renormalization.
+            do
+            {
+                v = (v << 8) | unsigned(*++p);
+            }
+            while ((l <<= 8) < AC__MinLength);
+
+        countSymbol(model, s, false);
+
+        data[k] = (unsigned char) s;
+        c = nextContext(c, s);
+    }
+
+    value = v;
+    length = l;
+    acPointer = p;
+    context = c;
+}
+
 #endif
@@ -1,30 +1,135 @@
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 #include "ac_codec.h"
 
 const char * WRITE_ERROR_MSG = "cannot write to file";
 const char * READ_ERROR_MSG = "cannot read from file";
 
-const unsigned numModels  = 16; /// MUST be a power of 2
-const unsigned bufferSize = 65536;
-const unsigned FILE_ID    = 0xA8BC3B39U;
+const unsigned numModels      = 16; /// MUST be a power of 2
+const unsigned bufferSize     = 65536;
+const unsigned codeBufferSize = 2 * bufferSize; /// Room for data that does not compress.
+const unsigned FILE_ID        = 0xA8BC3B39U;
+const unsigned FILE_ID_EXT    = 0xA8BC3B3AU; /// Header followed by 4-byte options.
+const unsigned ARCHIVE_ID     = 0xA8BC3B3BU; /// Header: options, directory position.
+
+/// Compression options, saved in extended header.
+const unsigned OPTION_SYMBOLS16 = 1; /// Data is a stream of 16-bit little-endian symbols.
+const unsigned OPTION_INDEX     = 2; /// Blocks are preceded by a trigram index for searching.
+const unsigned OPTION_DEDUP     = 4; /// Repeated blocks are saved as references to first copy.
+const unsigned OPTION_STATIC    = 8; /// Blocks are coded with static models, sent at block start.
+const unsigned OPTIONS_SUPPORTED = OPTION_SYMBOLS16 | OPTION_INDEX | OPTION_DEDUP | OPTION_STATIC;
+
+/// Transform of numeric data: type in option bits 8-9, element bytes in bits 12-15.
+const unsigned TRANSFORM_SHIFT  = 8;
+const unsigned TRANSFORM_PLANES = 1; /// Bytes split in planes by position in element.
+const unsigned TRANSFORM_DELTA  = 2; /// Difference to previous element, then planes.
+const unsigned TRANSFORM_XOR    = 3; /// Exclusive or with previous element, then planes.
+const unsigned MAX_ELEMENT_BYTES = 8;
+
+inline unsigned transformType(unsigned options) { return (options >> TRANSFORM_SHIFT) & 3; }
+inline unsigned elementBytes(unsigned options) { return (options >> (TRANSFORM_SHIFT + 4)) & 15; }
+
+/// Block types, with OPTION_DEDUP.
+const unsigned BLOCK_CODED     = 0;
+const unsigned BLOCK_REFERENCE = 1; /// Followed by 4-byte number of earlier block.
+const unsigned NO_REFERENCE    = 0xFFFFFFFFU;
 
-void encodeFile(char * dataFileName, char * encodedFileName);
+const unsigned INDEX_BYTES = 2048; /// Bits set for each trigram in block. MUST be a power of 2
+const unsigned TABLE_BITS  = 12;   /// Precision of static model frequencies.
+
+/// Context of next byte: low bits of current byte.
+/// A function object, so encodeBlock/decodeBlock are instantiated with the call inlined.
+struct NextContext
+{
+    unsigned operator()(unsigned, unsigned symbol) const { return symbol & (numModels - 1); }
+};
+const NextContext nextContext = NextContext();
+
+void encodeFile(char * dataFileName, char * encodedFileName, unsigned options);
 void decodeFile(char * encodedFileName, char * dataFileName);
+void grepFile(char * pattern, char * encodedFileName);
+void createArchive(char * archiveName, char * inputNames[], unsigned inputs, unsigned options);
+void extractArchive(char * archiveName, char * outputDirectory, char * fileName);
+void listArchive(char * archiveName);
+
+void printUsage()
+{
+    puts("\n Compression parameters:   ArithmeticCodeCodec -c[options] data_file_name compressed_file_name");
+    puts("\n Decompression parameters: ArithmeticCodeCodec -d compressed_file_name new_file_name");
+    puts("\n Search parameters:        ArithmeticCodeCodec -g pattern compressed_file_name");
+    puts("\n Archive parameters:       ArithmeticCodeCodec -a[options] archive_name file_or_directory ...");
+    puts("                           ArithmeticCodeCodec -x archive_name output_directory [file_name]");
+    puts("                           ArithmeticCodeCodec -l archive_name");
+    puts("\n Compression options:");
+    puts("   w   data is a stream of 16-bit little-endian symbols");
+    puts("   i   write block index, so a search decodes only blocks that may match");
+    puts("   r   save repeated 64 KB blocks as references to their first copy");
+    puts("   s   code each block with static models (faster decoding), not with w");
+    puts("   pN  split bytes of N-byte elements (N = 2 to 8) in planes, not with w or s");
+    puts("   dN  as pN, after taking difference of each little-endian element to previous one");
+    puts("   xN  as pN, after exclusive or of each element with previous one");
+    puts("   archives accept options r, s, pN, dN and xN\n");
+    exit(0);
+}
+
+unsigned parseOptions(const char * flags)
+{
+    unsigned options = 0;
+    for (; *flags; flags++)
+        switch (*flags)
+        {
+            case 'w': options |= OPTION_SYMBOLS16; break;
+            case 'i': options |= OPTION_INDEX; break;
+            case 'r': options |= OPTION_DEDUP; break;
+            case 's': options |= OPTION_STATIC; break;
+            case 'p':
+            case 'd':
+            case 'x':
+            {
+                unsigned type = (*flags == 'p' ? TRANSFORM_PLANES : *flags == 'd' ? TRANSFORM_DELTA : TRANSFORM_XOR);
+                unsigned width = unsigned(flags[1] - '0');
+                if (transformType(options) || (width < 2) || (width > MAX_ELEMENT_BYTES)) printUsage();
+                options |= (type << TRANSFORM_SHIFT) | (width << (TRANSFORM_SHIFT + 4));
+                ++flags;
+                break;
+            }
+            default: printUsage();
+        }
+    if ((options & OPTION_STATIC) && (options & OPTION_SYMBOLS16)) printUsage();
+    if (transformType(options) && (options & (OPTION_STATIC | OPTION_SYMBOLS16))) printUsage();
+    return options;
+}
 
 int main(int numberOfArguments, char * arguments[])
 {
     auto start = std::chrono::system_clock::now();
-    if ((numberOfArguments != 4) || (arguments[1][0] != '-') || ((arguments[1][1] != 'c') && (arguments[1][1] != 'd')))
-    {
-        puts("\n Compression parameters:   ArithmeticCodeCodec -c data_file_name compressed_file_name");
-        puts("\n Decompression parameters: ArithmeticCodeCodec -d compressed_file_name new_file_name\n");
-        exit(0);
-    }
+    if ((numberOfArguments < 3) || (arguments[1][0] != '-')) printUsage();
 
-    if (arguments[1][1] == 'c') encodeFile(arguments[2], arguments[3]);
-    else decodeFile(arguments[2], arguments[3]);
+    char mode = arguments[1][1];
+    if ((mode == 'c') && (numberOfArguments == 4)) encodeFile(arguments[2], arguments[3], parseOptions(arguments[1] + 2));
+    else if ((mode == 'a') && (numberOfArguments >= 4))
+        createArchive(arguments[2], arguments + 3, numberOfArguments - 3, parseOptions(arguments[1] + 2));
+    else if ((mode == 0) || (arguments[1][2] != 0)) printUsage();
+    else if ((mode == 'd') && (numberOfArguments == 4)) decodeFile(arguments[2], arguments[3]);
+    else if ((mode == 'g') && (numberOfArguments == 4)) grepFile(arguments[2], arguments[3]);
+    else if ((mode == 'x') && ((numberOfArguments == 4) || (numberOfArguments == 5)))
+        extractArchive(arguments[2], arguments[3], numberOfArguments == 5 ? arguments[4] : 0);
+    else if ((mode == 'l') && (numberOfArguments == 3)) listArchive(arguments[2]);
+    else printUsage();
 
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double> diff = end-start;
@@ -67,14 +172,14 @@ unsigned bufferCRC(unsigned bytes, unsigned char * buffer)
     return crc;
 }
 
-FILE * openInputFile(char * fileName)
+FILE * openInputFile(const char * fileName)
 {
     FILE * newFile = fopen(fileName, "rb");
     if (newFile == NULL) printError("cannot open input file");
     return newFile;
 }
 
-FILE * openOutputFile(char * fileName)
+FILE * openOutputFile(const char * fileName)
 {
     FILE * newFile = fopen(fileName, "rb");
     if (newFile != NULL)
@@ -85,7 +190,7 @@ FILE * openOutputFile(char * fileName)
         gets(input);
         if (input[0] != 'y') exit(0);
     }
-    newFile = fopen(fileName, "wb");
+    newFile = fopen(fileName, "w+b"); /// Decoder reads back repeated blocks.
     if (newFile == NULL) printError("cannot open output file");
     return newFile;
 }
@@ -103,7 +208,374 @@ unsigned recoverSavedNumber(unsigned char * buff) /// Recover 4-byte integer fro
     return unsigned(buff[0]) + (unsigned(buff[1]) << 8) + (unsigned(buff[2]) << 16) + (unsigned(buff[3]) << 24);
 }
 
-void encodeFile(char * dataFileName, char * encodedFileName)
+void writeHeader(FILE * encodedFile, unsigned crc, unsigned bytes, unsigned options)
+{
+    /// define 12-byte header, 16 bytes with options
+    unsigned char header[16];
+    unsigned headerBytes = (options ? 16 : 12);
+    saveNumber(options ? FILE_ID_EXT : FILE_ID, header);
+    saveNumber(crc,     header + 4);
+    saveNumber(bytes,   header + 8);
+    saveNumber(options, header + 12);
+    if (fwrite(header, 1, headerBytes, encodedFile) != headerBytes) printError(WRITE_ERROR_MSG);
+}
+
+void checkOptions(unsigned options)
+{
+    unsigned type = transformType(options), width = elementBytes(options);
+    if ((options & ~(OPTIONS_SUPPORTED | (0xF3U << TRANSFORM_SHIFT))) ||
+        (type ? (width < 2) || (width > MAX_ELEMENT_BYTES) : width != 0))
+        printError("unsupported compression options");
+}
+
+void readHeader(FILE * encodedFile, unsigned & crc, unsigned & bytes, unsigned & options)
+{
+    /// Read file information from 12-byte header, and options from extended header.
+    unsigned char header[16];
+    if (fread(header, 1, 12, encodedFile) != 12) printError(READ_ERROR_MSG);
+    unsigned fileID = recoverSavedNumber(header);
+    crc     = recoverSavedNumber(header + 4);
+    bytes   = recoverSavedNumber(header + 8);
+    options = 0;
+
+    if (fileID == FILE_ID_EXT)
+    {
+        if (fread(header + 12, 1, 4, encodedFile) != 4) printError(READ_ERROR_MSG);
+        options = recoverSavedNumber(header + 12);
+        checkOptions(options);
+    }
+    else if (fileID != FILE_ID) printError("invalid compressed file");
+}
+
+/// Block index: filter of the byte trigrams ending in the block.
+inline unsigned indexBit(unsigned trigram, unsigned hash)
+{
+    unsigned h = trigram * 0x9E3779B1U;
+    return (hash ? h >> 2 : h >> 17) & (8 * INDEX_BYTES - 1);
+}
+
+void buildIndex(const unsigned char * data, unsigned nb, unsigned & history, unsigned char * index)
+{
+    memset(index, 0, INDEX_BYTES);
+    for (unsigned p = 0; p < nb; p++)
+    {
+        history = ((history << 8) | data[p]) & 0xFFFFFFU; /// Last 3 bytes, also from previous block.
+        unsigned b1 = indexBit(history, 0), b2 = indexBit(history, 1);
+        index[b1 >> 3] |= (unsigned char)(1 << (b1 & 7));
+        index[b2 >> 3] |= (unsigned char)(1 << (b2 & 7));
+    }
+}
+
+bool indexHasTrigram(const unsigned char * index, unsigned trigram)
+{
+    unsigned b1 = indexBit(trigram, 0), b2 = indexBit(trigram, 1);
+    return ((index[b1 >> 3] >> (b1 & 7)) & (index[b2 >> 3] >> (b2 & 7)) & 1) != 0;
+}
+
+/// Models and codec shared by the data blocks of a compressed file.
+class BlockCoder
+{
+    public:
+        BlockCoder(unsigned fileOptions);
+        ~BlockCoder(void);
+        void encode(const unsigned char * data, unsigned nb, FILE * encodedFile);
+        void encodeReference(unsigned block, const unsigned char * data, unsigned nb, FILE * encodedFile);
+        unsigned decode(FILE * encodedFile, unsigned char * data, unsigned nb); /// Returns referenced block.
+        void copied(const unsigned char * data, unsigned nb); /// Data of referenced block was copied.
+        void skip(FILE * encodedFile, unsigned char * index = 0); /// Move past block, reading its index.
+
+    private:
+        void startBlock(const unsigned char * data, unsigned nb, FILE * encodedFile);
+        void writeType(unsigned type, FILE * encodedFile);
+        unsigned readType(FILE * encodedFile);
+        void encodeTables(const unsigned char * data, unsigned nb);
+        void decodeTables(void);
+        void transform(const unsigned char * data, unsigned nb);
+        void inverseTransform(unsigned char * data, unsigned nb);
+        void encodePlanes(const unsigned char * data, unsigned nb);
+        void decodePlanes(unsigned char * data, unsigned nb);
+        unsigned options, context, indexHistory;
+        ModelBank dataModel; /// Created on first use.
+        ModelBank planeModel; /// Context: plane and previous byte in plane.
+        unsigned char * planes;
+        LargeAdaptiveDataModel symbolModel;
+        StaticDataModel staticModel[numModels]; /// Set for each block.
+        AdaptiveDataModel tableModel; /// Bit length of static model frequencies.
+        unsigned frequency[numModels][256];
+        ArithmeticCodec codec;
+};
+
+BlockCoder::BlockCoder(unsigned fileOptions) : dataModel(numModels, 256), codec(codeBufferSize)
+{
+    options = fileOptions;
+    context = indexHistory = 0;
+    planes = 0;
+    if (options & OPTION_SYMBOLS16) symbolModel.setAlphabet(1 << 16);
+    if (options & OPTION_STATIC) tableModel.setAlphabet(TABLE_BITS + 2);
+    if (transformType(options))
+    {
+        planes = new unsigned char[bufferSize];
+        planeModel.setContexts((elementBytes(options) + 1) << 8, 256); /// Last plane: bytes after last element.
+    }
+}
+
+BlockCoder::~BlockCoder()
+{
+    delete [] planes;
+}
+
+/// Elements are little-endian, and restart from zero at each block.
+void BlockCoder::transform(const unsigned char * data, unsigned nb)
+{
+    unsigned width = elementBytes(options), type = transformType(options), elements = nb / width;
+    unsigned long long previous = 0, element, difference;
+
+    for (unsigned e = 0; e < elements; e++, data += width)
+    {
+        element = 0;
+        for (unsigned j = 0; j < width; j++) element |= (unsigned long long)(data[j]) << (8 * j);
+
+        if (type == TRANSFORM_DELTA) difference = element - previous;
+        else if (type == TRANSFORM_XOR) difference = element ^ previous;
+        else difference = element;
+        previous = element;
+
+        for (unsigned j = 0; j < width; j++) planes[j * elements + e] = (unsigned char)(difference >> (8 * j));
+    }
+    memcpy(planes + width * elements, data, nb - width * elements);
+}
+
+void BlockCoder::inverseTransform(unsigned char * data, unsigned nb)
+{
+    unsigned width = elementBytes(options), type = transformType(options), elements = nb / width;
+    unsigned long long previous = 0, element, difference;
+
+    for (unsigned e = 0; e < elements; e++, data += width)
+    {
+        difference = 0;
+        for (unsigned j = 0; j < width; j++) difference |= (unsigned long long)(planes[j * elements + e]) << (8 * j);
+
+        if (type == TRANSFORM_DELTA) element = previous + difference;
+        else if (type == TRANSFORM_XOR) element = previous ^ difference;
+        else element = difference;
+        previous = element;
+
+        for (unsigned j = 0; j < width; j++) data[j] = (unsigned char)(element >> (8 * j));
+    }
+    memcpy(data, planes + width * elements, nb - width * elements);
+}
+
+/// Context of next byte in plane: same plane, current byte.
+struct NextPlaneContext
+{
+    unsigned operator()(unsigned context, unsigned symbol) const { return (context & ~0xFFU) | symbol; }
+};
+const NextPlaneContext nextPlaneContext = NextPlaneContext();
+
+void BlockCoder::encodePlanes(const unsigned char * data, unsigned nb)
+{
+    unsigned width = elementBytes(options), elements = nb / width;
+    transform(data, nb);
+    for (unsigned j = 0; j <= width; j++)
+    {
+        unsigned planeContext = j << 8, planeBytes = (j < width ? elements : nb - width * elements);
+        codec.encodeBlock(planes + j * elements, planeBytes, planeModel, planeContext, nextPlaneContext);
+    }
+}
+
+void BlockCoder::decodePlanes(unsigned char * data, unsigned nb)
+{
+    unsigned width = elementBytes(options), elements = nb / width;
+    for (unsigned j = 0; j <= width; j++)
+    {
+        unsigned planeContext = j << 8, planeBytes = (j < width ? elements : nb - width * elements);
+        codec.decodeBlock(planes + j * elements, planeBytes, planeModel, planeContext, nextPlaneContext);
+    }
+    inverseTransform(data, nb);
+}
+
+/// Count bytes in each context, and code frequencies scaled to TABLE_BITS.
+void BlockCoder::encodeTables(const unsigned char * data, unsigned nb)
+{
+    unsigned counts[numModels], c = context;
+    memset(counts, 0, sizeof(counts));
+    memset(frequency, 0, sizeof(frequency));
+    for (unsigned p = 0; p < nb; p++)
+    {
+        ++frequency[c][data[p]];
+        ++counts[c];
+        c = nextContext(c, data[p]);
+    }
+
+    tableModel.reset();
+    for (c = 0; c < numModels; c++)
+    {
+        codec.putBits(counts[c] != 0, 1);
+        if (counts[c] == 0) continue;
+
+        for (unsigned k = 0; k < 256; k++)
+        {
+            unsigned f = frequency[c][k], bits = 0;
+            if (f != 0)
+            {
+                f = (f << TABLE_BITS) / counts[c];
+                if (f == 0) f = 1;
+                frequency[c][k] = f;
+            }
+            while (f >> bits) ++bits;
+
+            /// Bit length, then bits after the leading one.
+            codec.encode(bits, tableModel);
+            if (bits > 1) codec.putBits(f - (1U << (bits - 1)), bits - 1);
+        }
+        staticModel[c].setFrequencies(256, frequency[c]);
+    }
+}
+
+void BlockCoder::decodeTables()
+{
+    tableModel.reset();
+    for (unsigned c = 0; c < numModels; c++)
+    {
+        if (codec.getBits(1) == 0) continue;
+
+        for (unsigned k = 0; k < 256; k++)
+        {
+            unsigned bits = codec.decode(tableModel);
+            frequency[c][k] = (bits == 0 ? 0 : 1U << (bits - 1));
+            if (bits > 1) frequency[c][k] += codec.getBits(bits - 1);
+        }
+        staticModel[c].setFrequencies(256, frequency[c]);
+    }
+}
+
+/// Set models for a new block. Encoder writes block index; decoder moves past it (data = 0).
+void BlockCoder::startBlock(const unsigned char * data, unsigned nb, FILE * encodedFile)
+{
+    if (options & OPTION_INDEX) /// Indexed blocks can be decoded alone.
+    {
+        dataModel.reset();
+        planeModel.reset();
+        symbolModel.reset();
+        context = 0;
+
+        if (data == 0)
+        {
+            if (fseek(encodedFile, INDEX_BYTES, SEEK_CUR)) printError(READ_ERROR_MSG);
+            return;
+        }
+        unsigned char index[INDEX_BYTES];
+        buildIndex(data, nb, indexHistory, index);
+        if (fwrite(index, 1, INDEX_BYTES, encodedFile) != INDEX_BYTES) printError(WRITE_ERROR_MSG);
+    }
+}
+
+void BlockCoder::writeType(unsigned type, FILE * encodedFile)
+{
+    if ((options & OPTION_DEDUP) && (putc(int(type), encodedFile) == EOF)) printError(WRITE_ERROR_MSG);
+}
+
+unsigned BlockCoder::readType(FILE * encodedFile)
+{
+    if ((options & OPTION_DEDUP) == 0) return BLOCK_CODED;
+    int type = getc(encodedFile);
+    if (type == EOF) printError(READ_ERROR_MSG);
+    if (unsigned(type) > BLOCK_REFERENCE) printError("invalid block type");
+    return unsigned(type);
+}
+
+void BlockCoder::encodeReference(unsigned block, const unsigned char * data, unsigned nb, FILE * encodedFile)
+{
+    startBlock(data, nb, encodedFile);
+    writeType(BLOCK_REFERENCE, encodedFile);
+
+    unsigned char number[4];
+    saveNumber(block, number);
+    if (fwrite(number, 1, 4, encodedFile) != 4) printError(WRITE_ERROR_MSG);
+    copied(data, nb);
+}
+
+void BlockCoder::copied(const unsigned char * data, unsigned nb)
+{
+    if (nb && !(options & OPTION_SYMBOLS16)) context = nextContext(context, data[nb-1]);
+}
+
+void BlockCoder::encode(const unsigned char * data, unsigned nb, FILE * encodedFile)
+{
+    startBlock(data, nb, encodedFile);
+    writeType(BLOCK_CODED, encodedFile);
+
+    codec.startEncoder();
+    if (options & OPTION_SYMBOLS16)
+        for (unsigned p = 0; p < nb; p += 2) codec.encode(unsigned(data[p]) | (unsigned(data[p+1]) << 8), symbolModel);
+    else if (options & OPTION_STATIC)
+    {
+        encodeTables(data, nb);
+        codec.encodeBlock(data, nb, staticModel, context, nextContext);
+    }
+    else if (transformType(options))
+        encodePlanes(data, nb);
+    else
+        codec.encodeBlock(data, nb, dataModel, context, nextContext); /// Compress data.
+
+    codec.writeToFile(encodedFile);  /// Stop the encoder and write compressed data.
+}
+
+unsigned BlockCoder::decode(FILE * encodedFile, unsigned char * data, unsigned nb)
+{
+    startBlock(0, nb, encodedFile);
+    if (readType(encodedFile) == BLOCK_REFERENCE)
+    {
+        unsigned char number[4];
+        if (fread(number, 1, 4, encodedFile) != 4) printError(READ_ERROR_MSG);
+        return recoverSavedNumber(number);
+    }
+
+    codec.readFromFile(encodedFile); /// Read compressed data and start decoder.
+    if (options & OPTION_SYMBOLS16)
+        for (unsigned p = 0; p < nb; p += 2)
+        {
+            unsigned symbol = codec.decode(symbolModel);
+            data[p]   = (unsigned char)(symbol & 0xFFU);
+            data[p+1] = (unsigned char)(symbol >> 8);
+        }
+    else if (options & OPTION_STATIC)
+    {
+        decodeTables(); /// No model updates while decoding data.
+        codec.decodeBlock(data, nb, staticModel, context, nextContext);
+    }
+    else if (transformType(options))
+        decodePlanes(data, nb);
+    else
+        codec.decodeBlock(data, nb, dataModel, context, nextContext); /// Decompress data.
+    codec.stopDecoder();
+    return NO_REFERENCE;
+}
+
+void BlockCoder::skip(FILE * encodedFile, unsigned char * index)
+{
+    if (options & OPTION_INDEX)
+    {
+        if (index == 0) { if (fseek(encodedFile, INDEX_BYTES, SEEK_CUR)) printError(READ_ERROR_MSG); }
+        else if (fread(index, 1, INDEX_BYTES, encodedFile) != INDEX_BYTES) printError(READ_ERROR_MSG);
+    }
+    if (readType(encodedFile) == BLOCK_REFERENCE)
+    {
+        if (fseek(encodedFile, 4, SEEK_CUR)) printError(READ_ERROR_MSG);
+    }
+    else codec.skipInFile(encodedFile);
+}
+
+/// Read block saved earlier in file, at same position as in the data.
+void readEarlierBlock(FILE * file, unsigned block, unsigned char * data, unsigned nb)
+{
+    long position = ftell(file);
+    if (fseek(file, long(block) * long(bufferSize), SEEK_SET) || (fread(data, 1, nb, file) != nb) ||
+        fseek(file, position, SEEK_SET))
+        printError("invalid block reference");
+}
+
+void encodeFile(char * dataFileName, char * encodedFileName, unsigned options)
 {
     FILE * dataFile = openInputFile(dataFileName);
     FILE * encodedFile = openOutputFile(encodedFileName);
@@ -119,33 +591,37 @@ void encodeFile(char * dataFileName, char * encodedFileName)
     }
     while (nb == bufferSize);
 
-    /// define 12-byte header
-    unsigned char header[12];
-    saveNumber(FILE_ID, header    );
-    saveNumber(crc,     header + 4);
-    saveNumber(bytes,   header + 8);
-    if (fwrite(header, 1, 12, encodedFile) != 12) printError(WRITE_ERROR_MSG);
-    AdaptiveDataModel dataModel[numModels]; /// Set data models.
-    for (unsigned m = 0; m < numModels; m++) dataModel[m].setAlphabet(256);
+    if ((options & OPTION_SYMBOLS16) && (bytes & 1)) printError("16-bit symbol file has odd number of bytes");
 
-    ArithmeticCodec encoder(bufferSize); /// Set encoder buffer.
+    writeHeader(encodedFile, crc, bytes, options);
+    BlockCoder encoder(options); /// Set data models and encoder buffer.
 
     rewind(dataFile); /// So the file can be read again.
 
-    unsigned context = 0;
+    /// First block with each CRC, and buffer to check that blocks are equal.
+    std::unordered_map<unsigned, unsigned> firstBlock;
+    unsigned char * earlier = (options & OPTION_DEDUP ? new unsigned char[bufferSize] : 0);
+
+    unsigned block = 0;
     do
     {
         nb = (bytes < bufferSize ? bytes : bufferSize);
         if (fread(data, 1, nb, dataFile) != nb) printError(READ_ERROR_MSG); /// Read input file data.
 
-        encoder.startEncoder();
-        for (unsigned p = 0; p < nb; p++) /// Compress data.
+        unsigned reference = NO_REFERENCE;
+        if ((options & OPTION_DEDUP) && (nb == bufferSize))
         {
-            encoder.encode(data[p], dataModel[context]);
-            context = (unsigned)(data[p]) & (numModels - 1);
+            auto found = firstBlock.insert(std::make_pair(bufferCRC(nb, data), block));
+            if (!found.second)
+            {
+                readEarlierBlock(dataFile, found.first->second, earlier, nb);
+                if (memcmp(earlier, data, nb) == 0) reference = found.first->second;
+            }
         }
 
-        encoder.writeToFile(encodedFile);  /// Stop the encoder and write compressed data.
+        if (reference != NO_REFERENCE) encoder.encodeReference(reference, data, nb, encodedFile);
+        else encoder.encode(data, nb, encodedFile);
+        ++block;
     }
     while (bytes -= nb);
 
@@ -157,6 +633,7 @@ void encodeFile(char * dataFileName, char * encodedFileName)
     fclose(encodedFile);
 
     delete [] data;
+    delete [] earlier;
 }
 
 void decodeFile(char * encodedFileName, char * dataFileName)
@@ -164,37 +641,24 @@ void decodeFile(char * encodedFileName, char * dataFileName)
     FILE * encodedFile = openInputFile(encodedFileName);
     FILE * dataFile = openOutputFile(dataFileName);
 
-    /// Read file information from 12-byte header.
-    unsigned char header[12];
-    if (fread(header, 1, 12, encodedFile) != 12) printError(READ_ERROR_MSG);
-    unsigned fileID = recoverSavedNumber(header);
-    unsigned crc    = recoverSavedNumber(header + 4);
-    unsigned bytes  = recoverSavedNumber(header + 8);
-
-    if (fileID != FILE_ID) printError("invalid compressed file");
+    unsigned crc, bytes, options;
+    readHeader(encodedFile, crc, bytes, options);
 
     unsigned char * data = new unsigned char[bufferSize]; /// Buffer for output file data.
 
-    /// Set data models.
-    AdaptiveDataModel dataModel[numModels];
-    for (unsigned m = 0; m < numModels; m++) dataModel[m].setAlphabet(256);
-
-    ArithmeticCodec decoder(bufferSize); /// Set encoder buffer.
+    BlockCoder decoder(options); /// Set data models and decoder buffer.
 
     /// Decompress file.
-    unsigned nb, newCRC = 0, context = 0;
+    unsigned nb, newCRC = 0;
     do
     {
-        decoder.readFromFile(encodedFile); /// Read compressed data and start decoder.
-
         nb = (bytes < bufferSize ? bytes : bufferSize);
-        /// Decompress data.
-        for (unsigned p = 0; p < nb; p++)
+        unsigned reference = decoder.decode(encodedFile, data, nb);
+        if (reference != NO_REFERENCE)
         {
-            data[p] = (unsigned char) decoder.decode(dataModel[context]);
-            context = (unsigned)(data[p]) & (numModels - 1);
+            readEarlierBlock(dataFile, reference, data, nb); /// Copy from new file.
+            decoder.copied(data, nb);
         }
-        decoder.stopDecoder();
 
         newCRC ^= bufferCRC(nb, data); /// Compute CRC of the new file.
         if (fwrite(data, 1, nb, dataFile) != nb) printError(WRITE_ERROR_MSG);
@@ -209,3 +673,482 @@ void decodeFile(char * encodedFileName, char * dataFileName)
     /// Check file validity.
     if (crc != newCRC) printError("incorrect file CRC");
 }
+
+/// Print the lines with matches starting in the first block of the window.
+/// Window starts with the part of the line before its first byte (head, no '\n').
+void printMatches(const char * pattern, unsigned patternBytes, const unsigned char * window, unsigned headBytes,
+                  bool headAtLineStart, unsigned firstBytes, unsigned windowBytes, unsigned windowOffset,
+                  unsigned & printedUpTo)
+{
+    unsigned textOffset = windowOffset - headBytes; /// Offset of window[0] in file.
+    firstBytes += headBytes;
+    windowBytes += headBytes;
+    for (unsigned p = headBytes; (p < firstBytes) && (p + patternBytes <= windowBytes); p++)
+    {
+        if ((textOffset + p < printedUpTo) || (memcmp(window + p, pattern, patternBytes) != 0)) continue;
+
+        /// Line is clipped to head and decoded window; "..." shows it starts earlier.
+        unsigned lineStart = p, lineEnd = p + patternBytes;
+        while ((lineStart > 0) && (window[lineStart-1] != '\n')) --lineStart;
+        while ((lineEnd < windowBytes) && (window[lineEnd] != '\n')) ++lineEnd;
+        printedUpTo = textOffset + lineEnd;
+        if ((lineEnd > p + patternBytes) && (window[lineEnd-1] == '\r')) --lineEnd;
+        printf("%u: %s%.*s\n", textOffset + lineStart, (lineStart == 0) && !headAtLineStart ? "..." : "",
+               int(lineEnd - lineStart), (const char *)(window + lineStart));
+    }
+}
+
+void grepFile(char * pattern, char * encodedFileName)
+{
+    FILE * encodedFile = openInputFile(encodedFileName);
+
+    unsigned crc, bytes, options;
+    readHeader(encodedFile, crc, bytes, options);
+
+    unsigned patternBytes = unsigned(strlen(pattern));
+    if ((patternBytes == 0) || (patternBytes > bufferSize)) printError("invalid search pattern");
+
+    /// Blocks k-1, k and k+1: data, index, position in file. Block k-1 gives the
+    /// start of the line that continues in block k.
+    unsigned char * window = new unsigned char[3*bufferSize];
+    unsigned char * index = new unsigned char[3*INDEX_BYTES];
+    unsigned blockBytes[3] = { 0, 0, 0 };
+    long blockPosition[3];
+    bool decoded[3] = { false, false, false };
+    bool previousAtLineStart = true; /// Block k-1 starts a line.
+
+    BlockCoder decoder(options);
+    bool indexed = (options & OPTION_INDEX) != 0;
+    unsigned blocks = 0, decodedBlocks = 0, offset = 0, printedUpTo = 0;
+
+    /// Repeated blocks are copied from earlier blocks: decoded again from their
+    /// position in file or, without an index, read from a file of decoded data.
+    std::vector<long> earlierPosition;
+    FILE * decodedFile = 0;
+    if ((options & OPTION_DEDUP) && !indexed && ((decodedFile = tmpfile()) == NULL))
+        printError("cannot open temporary file");
+
+    auto decodeReference = [&](unsigned char * data, unsigned nb)
+    {
+        unsigned reference = decoder.decode(encodedFile, data, nb);
+        if (reference == NO_REFERENCE) return;
+        if (indexed)
+        {
+            if ((reference >= earlierPosition.size()) || fseek(encodedFile, earlierPosition[reference], SEEK_SET) ||
+                (decoder.decode(encodedFile, data, nb) != NO_REFERENCE))
+                printError("invalid block reference");
+        }
+        else
+        {
+            readEarlierBlock(decodedFile, reference, data, nb);
+            decoder.copied(data, nb);
+        }
+    };
+
+    /// Without an index every block is decoded, in order.
+    auto readBlock = [&](unsigned k)
+    {
+        blockBytes[k] = (bytes < bufferSize ? bytes : bufferSize);
+        bytes -= blockBytes[k];
+        blockPosition[k] = ftell(encodedFile);
+        if (indexed && (options & OPTION_DEDUP)) earlierPosition.push_back(blockPosition[k]);
+
+        if ((decoded[k] = !indexed))
+        {
+            decodeReference(window + k * bufferSize, blockBytes[k]);
+            if (decodedFile && (fwrite(window + k * bufferSize, 1, blockBytes[k], decodedFile) != blockBytes[k]))
+                printError(WRITE_ERROR_MSG);
+        }
+        else decoder.skip(encodedFile, index + k * INDEX_BYTES);
+        ++blocks;
+    };
+    auto decodeBlock = [&](unsigned k)
+    {
+        if (decoded[k] || (blockBytes[k] == 0)) return;
+        long position = ftell(encodedFile);
+        fseek(encodedFile, blockPosition[k], SEEK_SET);
+        decodeReference(window + k * bufferSize, blockBytes[k]);
+        fseek(encodedFile, position, SEEK_SET);
+        decoded[k] = true;
+        ++decodedBlocks;
+    };
+
+    if (bytes) readBlock(1);
+    while (blockBytes[1])
+    {
+        if (bytes) readBlock(2);
+        else blockBytes[2] = 0;
+
+        /// Matches from block k have all trigrams in the index of block k or k+1.
+        bool candidate = true;
+        if (indexed)
+            for (unsigned p = 0; candidate && (p + 3 <= patternBytes); p++)
+            {
+                unsigned trigram = (unsigned((unsigned char)pattern[p]) << 16) |
+                                   (unsigned((unsigned char)pattern[p+1]) << 8) | unsigned((unsigned char)pattern[p+2]);
+                candidate = indexHasTrigram(index + INDEX_BYTES, trigram) ||
+                            ((blockBytes[2] != 0) && indexHasTrigram(index + 2 * INDEX_BYTES, trigram));
+            }
+
+        if (candidate)
+        {
+            decodeBlock(0);
+            decodeBlock(1);
+            decodeBlock(2);
+
+            /// Head: end of block k-1, after its last line break.
+            unsigned headBytes = 0;
+            while ((headBytes < blockBytes[0]) && (window[bufferSize-headBytes-1] != '\n')) ++headBytes;
+            printMatches(pattern, patternBytes, window + bufferSize - headBytes, headBytes,
+                         (headBytes < blockBytes[0]) || previousAtLineStart, blockBytes[1],
+                         blockBytes[1] + blockBytes[2], offset, printedUpTo);
+        }
+
+        /// Block k becomes block k-1, and block k+1 becomes block k.
+        if (blockBytes[0] != 0) previousAtLineStart = decoded[0] && (window[bufferSize-1] == '\n');
+        offset += blockBytes[1];
+        for (unsigned k = 0; k < 2; k++)
+        {
+            blockBytes[k] = blockBytes[k+1];
+            blockPosition[k] = blockPosition[k+1];
+            decoded[k] = decoded[k+1];
+            memcpy(index + k * INDEX_BYTES, index + (k + 1) * INDEX_BYTES, INDEX_BYTES);
+        }
+        if (decoded[0]) memcpy(window, window + bufferSize, blockBytes[0]); /// Full, as block k follows.
+        if (decoded[1]) memcpy(window + bufferSize, window + 2 * bufferSize, blockBytes[1]);
+    }
+
+    if (indexed) printf(" Decoded %u of %u blocks\n", decodedBlocks, blocks);
+    fclose(encodedFile);
+    if (decodedFile) fclose(decodedFile);
+
+    delete [] window;
+    delete [] index;
+}
+
+/// File saved in archive.
+struct ArchiveEntry
+{
+    std::string name;
+    unsigned group, offset, bytes, crc;
+};
+
+/// Files are grouped by extension; a group shares its models.
+std::string fileExtension(const std::string & name)
+{
+    size_t dot = name.rfind('.'), slash = name.rfind('/');
+    if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash))) return std::string();
+    return name.substr(dot + 1);
+}
+
+/// Add file, or all files under directory, in name order.
+void addInputFiles(const std::string & path, std::vector<std::string> & files)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES) printError("cannot open input file");
+    if ((attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+    {
+        files.push_back(path);
+        return;
+    }
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((path + "/*").c_str(), &found);
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+            if (strcmp(found.cFileName, ".") && strcmp(found.cFileName, "..")) names.push_back(found.cFileName);
+        while (FindNextFileA(search, &found));
+        FindClose(search);
+    }
+#else
+    struct stat information;
+    if (stat(path.c_str(), &information) != 0) printError("cannot open input file");
+    if (!S_ISDIR(information.st_mode))
+    {
+        files.push_back(path);
+        return;
+    }
+    DIR * directory = opendir(path.c_str());
+    if (directory == NULL) printError("cannot open input directory");
+    while (struct dirent * entry = readdir(directory))
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) names.push_back(entry->d_name);
+    closedir(directory);
+#endif
+    std::sort(names.begin(), names.end());
+    for (const std::string & name : names) addInputFiles(path + "/" + name, files);
+}
+
+/// Both names refer to one existing file.
+bool isSameFile(const std::string & first, const std::string & second)
+{
+#ifdef _WIN32
+    char firstPath[MAX_PATH], secondPath[MAX_PATH];
+    if (!GetFullPathNameA(first.c_str(), MAX_PATH, firstPath, 0) ||
+        !GetFullPathNameA(second.c_str(), MAX_PATH, secondPath, 0)) return false;
+    return (GetFileAttributesA(firstPath) != INVALID_FILE_ATTRIBUTES) && (_stricmp(firstPath, secondPath) == 0);
+#else
+    struct stat firstInformation, secondInformation;
+    if ((stat(first.c_str(), &firstInformation) != 0) || (stat(second.c_str(), &secondInformation) != 0)) return false;
+    return (firstInformation.st_dev == secondInformation.st_dev) && (firstInformation.st_ino == secondInformation.st_ino);
+#endif
+}
+
+/// Name saved in archive: relative, with '/' separators.
+std::string archivedName(std::string path)
+{
+    std::replace(path.begin(), path.end(), '\\', '/');
+    for (;;)
+        if (path.compare(0, 1, "/") == 0) path.erase(0, 1);
+        else if (path.compare(0, 2, "./") == 0) path.erase(0, 2);
+        else if (path.compare(0, 3, "../") == 0) path.erase(0, 3);
+        else return path;
+}
+
+/// Name stays under output directory: not empty or absolute, no '\\', ':' or ".." part.
+bool isRelativeName(const std::string & name)
+{
+    if (name.empty() || (name[0] == '/') || (name.find_first_of("\\:") != std::string::npos)) return false;
+    for (size_t start = 0, end; start <= name.size(); start = end + 1)
+    {
+        if ((end = name.find('/', start)) == std::string::npos) end = name.size();
+        if (name.compare(start, end - start, "..") == 0) return false;
+    }
+    return true;
+}
+
+void createDirectories(const std::string & path) /// Directories in path, up to last '/'.
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        std::string directory = path.substr(0, slash);
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0777);
+#endif
+    }
+}
+
+void createArchive(char * archiveName, char * inputNames[], unsigned inputs, unsigned options)
+{
+    if (options & (OPTION_SYMBOLS16 | OPTION_INDEX)) printError("options i and w are not used in archives");
+
+    std::vector<std::string> files;
+    for (unsigned k = 0; k < inputs; k++) addInputFiles(inputNames[k], files);
+    /// An archive from an earlier run may be under an input directory.
+    files.erase(std::remove_if(files.begin(), files.end(),
+                               [archiveName](const std::string & name) { return isSameFile(name, archiveName); }),
+                files.end());
+    std::stable_sort(files.begin(), files.end(),
+                     [](const std::string & a, const std::string & b) { return fileExtension(a) < fileExtension(b); });
+
+    FILE * archiveFile = openOutputFile(archiveName);
+
+    /// 12-byte header; directory position is set at the end.
+    unsigned char header[12];
+    saveNumber(ARCHIVE_ID, header);
+    saveNumber(options, header + 4);
+    saveNumber(0, header + 8);
+    if (fwrite(header, 1, 12, archiveFile) != 12) printError(WRITE_ERROR_MSG);
+
+    unsigned char * data = new unsigned char[bufferSize];
+    std::vector<ArchiveEntry> entries(files.size());
+    BlockCoder * encoder = 0;
+    unsigned groups = 0, dataBytes = 0;
+
+    /// Repeated blocks refer to full blocks of their group, numbered in order:
+    /// first block with each CRC, and file and block in file of each number.
+    std::unordered_map<unsigned, unsigned> firstBlock;
+    std::vector<std::pair<unsigned, unsigned> > groupBlock;
+    unsigned char * earlier = (options & OPTION_DEDUP ? new unsigned char[bufferSize] : 0);
+
+    for (unsigned k = 0; k < files.size(); k++)
+    {
+        ArchiveEntry & entry = entries[k];
+        if ((k == 0) || (fileExtension(files[k]) != fileExtension(files[k-1])))
+        {
+            delete encoder; /// New group, new models.
+            encoder = new BlockCoder(options);
+            firstBlock.clear();
+            groupBlock.clear();
+            ++groups;
+        }
+
+        entry.name   = archivedName(files[k]);
+        if (!isRelativeName(entry.name)) printError("cannot save file name in archive");
+        entry.group  = groups - 1;
+        entry.offset = unsigned(ftell(archiveFile));
+        entry.bytes  = entry.crc = 0;
+
+        FILE * dataFile = openInputFile(files[k].c_str());
+        unsigned nb;
+        for (unsigned block = 0; (nb = unsigned(fread(data, 1, bufferSize, dataFile))) != 0; block++)
+        {
+            unsigned blockCRC = bufferCRC(nb, data), reference = NO_REFERENCE;
+            entry.crc ^= blockCRC;
+            entry.bytes += nb;
+
+            if ((options & OPTION_DEDUP) && (nb == bufferSize))
+            {
+                auto found = firstBlock.insert(std::make_pair(blockCRC, unsigned(groupBlock.size())));
+                if (!found.second)
+                {
+                    const std::pair<unsigned, unsigned> & source = groupBlock[found.first->second];
+                    FILE * earlierFile = (source.first == k ? dataFile : openInputFile(files[source.first].c_str()));
+                    readEarlierBlock(earlierFile, source.second, earlier, nb);
+                    if (earlierFile != dataFile) fclose(earlierFile);
+                    if (memcmp(earlier, data, nb) == 0) reference = found.first->second;
+                }
+                groupBlock.push_back(std::make_pair(k, block));
+            }
+
+            if (reference != NO_REFERENCE) encoder->encodeReference(reference, data, nb, archiveFile);
+            else encoder->encode(data, nb, archiveFile);
+        }
+        fclose(dataFile);
+        dataBytes += entry.bytes;
+    }
+    delete encoder;
+
+    /// Directory: number of files, then position, size, CRC, group and name of each file.
+    unsigned directoryOffset = unsigned(ftell(archiveFile));
+    unsigned char number[20];
+    saveNumber(unsigned(entries.size()), number);
+    if (fwrite(number, 1, 4, archiveFile) != 4) printError(WRITE_ERROR_MSG);
+    for (const ArchiveEntry & entry : entries)
+    {
+        saveNumber(entry.offset, number);
+        saveNumber(entry.bytes,  number + 4);
+        saveNumber(entry.crc,    number + 8);
+        saveNumber(entry.group,  number + 12);
+        saveNumber(unsigned(entry.name.size()), number + 16);
+        if ((fwrite(number, 1, 20, archiveFile) != 20) ||
+            (fwrite(entry.name.data(), 1, entry.name.size(), archiveFile) != entry.name.size()))
+            printError(WRITE_ERROR_MSG);
+    }
+
+    saveNumber(directoryOffset, header + 8);
+    if (fseek(archiveFile, 8, SEEK_SET) || (fwrite(header + 8, 1, 4, archiveFile) != 4)) printError(WRITE_ERROR_MSG);
+
+    fseek(archiveFile, 0, SEEK_END);
+    unsigned archiveBytes = unsigned(ftell(archiveFile));
+    printf(" Archive size = %u bytes, %u files in %u groups (%.3f:1 compression)\n", archiveBytes,
+           unsigned(entries.size()), groups, double(dataBytes) / double(archiveBytes));
+    fclose(archiveFile);
+
+    delete [] data;
+    delete [] earlier;
+}
+
+FILE * readArchive(char * archiveName, unsigned & options, std::vector<ArchiveEntry> & entries)
+{
+    FILE * archiveFile = openInputFile(archiveName);
+
+    unsigned char number[20];
+    if (fread(number, 1, 12, archiveFile) != 12) printError(READ_ERROR_MSG);
+    if (recoverSavedNumber(number) != ARCHIVE_ID) printError("invalid archive file");
+    options = recoverSavedNumber(number + 4);
+    checkOptions(options);
+
+    if (fseek(archiveFile, long(recoverSavedNumber(number + 8)), SEEK_SET) ||
+        (fread(number, 1, 4, archiveFile) != 4)) printError(READ_ERROR_MSG);
+    entries.resize(recoverSavedNumber(number));
+
+    for (ArchiveEntry & entry : entries)
+    {
+        if (fread(number, 1, 20, archiveFile) != 20) printError(READ_ERROR_MSG);
+        entry.offset = recoverSavedNumber(number);
+        entry.bytes  = recoverSavedNumber(number + 4);
+        entry.crc    = recoverSavedNumber(number + 8);
+        entry.group  = recoverSavedNumber(number + 12);
+        entry.name.resize(recoverSavedNumber(number + 16));
+        if (fread(&entry.name[0], 1, entry.name.size(), archiveFile) != entry.name.size()) printError(READ_ERROR_MSG);
+    }
+    return archiveFile;
+}
+
+void extractArchive(char * archiveName, char * outputDirectory, char * fileName)
+{
+    unsigned options;
+    std::vector<ArchiveEntry> entries;
+    FILE * archiveFile = readArchive(archiveName, options, entries);
+
+    /// One file: decode its group from the first file, since models adapt across files.
+    unsigned first = 0, last = unsigned(entries.size());
+    if (fileName)
+    {
+        std::string name = archivedName(fileName);
+        for (last = 0; (last < entries.size()) && (entries[last].name != name); last++);
+        if (last == entries.size()) printError("file not found in archive");
+        for (first = last; (first > 0) && (entries[first-1].group == entries[last].group); first--);
+        ++last;
+    }
+
+    /// Check names before writing any file.
+    for (unsigned k = (fileName ? last - 1 : first); k < last; k++)
+        if (!isRelativeName(entries[k].name)) printError("invalid file name in archive");
+
+    unsigned char * data = new unsigned char[bufferSize];
+    BlockCoder * decoder = 0;
+
+    /// Full blocks of group, in order, for repeated blocks to copy.
+    FILE * groupFile = 0;
+
+    for (unsigned k = first; k < last; k++)
+    {
+        const ArchiveEntry & entry = entries[k];
+        if ((k == first) || (entry.group != entries[k-1].group))
+        {
+            delete decoder;
+            decoder = new BlockCoder(options);
+            if (groupFile) fclose(groupFile);
+            if ((options & OPTION_DEDUP) && ((groupFile = tmpfile()) == NULL))
+                printError("cannot open temporary file");
+        }
+        if (fseek(archiveFile, long(entry.offset), SEEK_SET)) printError(READ_ERROR_MSG);
+
+        FILE * dataFile = 0;
+        if ((fileName == 0) || (k + 1 == last))
+        {
+            std::string path = std::string(outputDirectory) + "/" + entry.name;
+            createDirectories(path);
+            dataFile = openOutputFile(path.c_str());
+        }
+
+        unsigned nb, crc = 0;
+        for (unsigned bytes = entry.bytes; bytes; bytes -= nb)
+        {
+            nb = (bytes < bufferSize ? bytes : bufferSize);
+            unsigned reference = decoder->decode(archiveFile, data, nb);
+            if (reference != NO_REFERENCE)
+            {
+                if (groupFile == 0) printError("invalid block reference");
+                readEarlierBlock(groupFile, reference, data, nb);
+                decoder->copied(data, nb);
+            }
+            if (groupFile && (nb == bufferSize) && (fwrite(data, 1, nb, groupFile) != nb)) printError(WRITE_ERROR_MSG);
+            crc ^= bufferCRC(nb, data);
+            if (dataFile && (fwrite(data, 1, nb, dataFile) != nb)) printError(WRITE_ERROR_MSG);
+        }
+        if (dataFile) fclose(dataFile);
+        if (crc != entry.crc) printError("incorrect file CRC");
+    }
+
+    delete decoder;
+    delete [] data;
+    if (groupFile) fclose(groupFile);
+    fclose(archiveFile);
+}
+
+void listArchive(char * archiveName)
+{
+    unsigned options;
+    std::vector<ArchiveEntry> entries;
+    fclose(readArchive(archiveName, options, entries));
+
+    for (const ArchiveEntry & entry : entries)
+        printf(" %10u  group %-3u  %s\n", entry.bytes, entry.group, entry.name.c_str());
+    printf(" %u files\n", unsigned(entries.size()));
+}
@@ -1,3 +1,5 @@
+CALL "SinkTest" "war_and_peace.txt"
+CALL "BankTest" "war_and_peace.txt"
 CALL "ArithmeticCodeCodec" "-c" "empty.txt" "empty.acf"
 CALL "ArithmeticCodeCodec" "-d" "empty.acf" "empty.out.txt"
 CALL "FC" "empty.txt" "empty.out.txt"
@@ -10,10 +12,64 @@ CALL "FC" "test.txt" "test.out.txt"
 CALL "ArithmeticCodeCodec" "-c" "war_and_peace.txt" "war_and_peace.acf"
 CALL "ArithmeticCodeCodec" "-d" "war_and_peace.acf" "war_and_peace.out.txt"
 CALL "FC" "war_and_peace.txt" "war_and_peace.out.txt"
+CALL "ArithmeticCodeCodec" "-g" "Prince Andrew" "war_and_peace.acf" | FINDSTR /B /R "[0-9][0-9]*:" > "war_and_peace.grep.out.txt"
+CALL "FC" "war_and_peace.grep.txt" "war_and_peace.grep.out.txt"
 CALL "ArithmeticCodeCodec" "-c" "large.txt" "large.acf"
 CALL "ArithmeticCodeCodec" "-d" "large.acf" "large.out.txt"
 CALL "FC" "large.txt" "large.out.txt"
+CALL "ArithmeticCodeCodec" "-cw" "war_and_peace.txt" "war_and_peace.w.acf"
+CALL "ArithmeticCodeCodec" "-d" "war_and_peace.w.acf" "war_and_peace.w.out.txt"
+CALL "FC" "war_and_peace.txt" "war_and_peace.w.out.txt"
+CALL "ArithmeticCodeCodec" "-ci" "war_and_peace.txt" "war_and_peace.i.acf"
+CALL "ArithmeticCodeCodec" "-d" "war_and_peace.i.acf" "war_and_peace.i.out.txt"
+CALL "FC" "war_and_peace.txt" "war_and_peace.i.out.txt"
+CALL "ArithmeticCodeCodec" "-g" "Prince Andrew" "war_and_peace.i.acf" | FINDSTR /B /R "[0-9][0-9]*:" > "war_and_peace.i.grep.out.txt"
+CALL "FC" "war_and_peace.grep.txt" "war_and_peace.i.grep.out.txt"
+CALL "ArithmeticCodeCodec" "-cri" "war_and_peace.txt" "war_and_peace.r.acf"
+CALL "ArithmeticCodeCodec" "-d" "war_and_peace.r.acf" "war_and_peace.r.out.txt"
+CALL "FC" "war_and_peace.txt" "war_and_peace.r.out.txt"
+CALL "ArithmeticCodeCodec" "-g" "Prince Andrew" "war_and_peace.r.acf" | FINDSTR /B /R "[0-9][0-9]*:" > "war_and_peace.r.grep.out.txt"
+CALL "FC" "war_and_peace.grep.txt" "war_and_peace.r.grep.out.txt"
+COPY /B "block.txt"+"block.txt"+"block.txt"+"test.txt" "repeated.txt"
+CALL "ArithmeticCodeCodec" "-cr" "repeated.txt" "repeated.r.acf"
+CALL "ArithmeticCodeCodec" "-d" "repeated.r.acf" "repeated.r.out.txt"
+CALL "FC" "repeated.txt" "repeated.r.out.txt"
+CALL "ArithmeticCodeCodec" "-g" "Hippolyte" "repeated.r.acf" | FINDSTR /B /R "[0-9][0-9]*:" > "repeated.r.grep.out.txt"
+CALL "FC" "repeated.grep.txt" "repeated.r.grep.out.txt"
+CALL "ArithmeticCodeCodec" "-cri" "repeated.txt" "repeated.ri.acf"
+CALL "ArithmeticCodeCodec" "-d" "repeated.ri.acf" "repeated.ri.out.txt"
+CALL "FC" "repeated.txt" "repeated.ri.out.txt"
+CALL "ArithmeticCodeCodec" "-g" "Hippolyte" "repeated.ri.acf" | FINDSTR /B /R "[0-9][0-9]*:" > "repeated.ri.grep.out.txt"
+CALL "FC" "repeated.grep.txt" "repeated.ri.grep.out.txt"
+CALL "ArithmeticCodeCodec" "-cs" "war_and_peace.txt" "war_and_peace.s.acf"
+CALL "ArithmeticCodeCodec" "-d" "war_and_peace.s.acf" "war_and_peace.s.out.txt"
+CALL "FC" "war_and_peace.txt" "war_and_peace.s.out.txt"
+CALL "ArithmeticCodeCodec" "-cd4" "war_and_peace.txt" "war_and_peace.d.acf"
+CALL "ArithmeticCodeCodec" "-d" "war_and_peace.d.acf" "war_and_peace.d.out.txt"
+CALL "FC" "war_and_peace.txt" "war_and_peace.d.out.txt"
+CALL "ArithmeticCodeCodec" "-cp4" "numbers.bin" "numbers.p.acf"
+CALL "ArithmeticCodeCodec" "-d" "numbers.p.acf" "numbers.p.out.bin"
+CALL "FC" "/B" "numbers.bin" "numbers.p.out.bin"
+CALL "ArithmeticCodeCodec" "-cd4" "numbers.bin" "numbers.d.acf"
+CALL "ArithmeticCodeCodec" "-d" "numbers.d.acf" "numbers.d.out.bin"
+CALL "FC" "/B" "numbers.bin" "numbers.d.out.bin"
+CALL "ArithmeticCodeCodec" "-cx2" "numbers.bin" "numbers.x.acf"
+CALL "ArithmeticCodeCodec" "-d" "numbers.x.acf" "numbers.x.out.bin"
+CALL "FC" "/B" "numbers.bin" "numbers.x.out.bin"
 CALL "ArithmeticCodeCodec" "-c" "different.txt" "different.acf"
 CALL "ArithmeticCodeCodec" "-d" "different.acf" "different.out.txt"
 CALL "FC" "different.txt" "different.out.txt"
-DEL "empty.acf" "empty.out.txt" "one.acf" "one.out.txt" "test.acf" "test.out.txt" "war_and_peace.acf" "war_and_peace.out.txt" "large.acf" "large.out.txt" "different.acf" "different.out.txt"
+CALL "ArithmeticCodeCodec" "-a" "test.aca" "one.txt" "test.txt" "war_and_peace.txt" "different.txt"
+CALL "ArithmeticCodeCodec" "-l" "test.aca"
+CALL "ArithmeticCodeCodec" "-x" "test.aca" "archive.out"
+CALL "FC" "war_and_peace.txt" "archive.out\war_and_peace.txt"
+CALL "FC" "different.txt" "archive.out\different.txt"
+CALL "ArithmeticCodeCodec" "-x" "test.aca" "archive.one" "test.txt"
+CALL "FC" "test.txt" "archive.one\test.txt"
+CALL "ArithmeticCodeCodec" "-ar" "repeated.aca" "block.txt" "repeated.txt" "test.txt"
+CALL "ArithmeticCodeCodec" "-x" "repeated.aca" "archive.r"
+CALL "FC" "repeated.txt" "archive.r\repeated.txt"
+CALL "ArithmeticCodeCodec" "-x" "repeated.aca" "archive.r1" "repeated.txt"
+CALL "FC" "repeated.txt" "archive.r1\repeated.txt"
+DEL "empty.acf" "empty.out.txt" "one.acf" "one.out.txt" "test.acf" "test.out.txt" "war_and_peace.acf" "war_and_peace.out.txt" "war_and_peace.grep.out.txt" "large.acf" "large.out.txt" "different.acf" "different.out.txt" "war_and_peace.w.acf" "war_and_peace.w.out.txt" "war_and_peace.i.acf" "war_and_peace.i.out.txt" "war_and_peace.i.grep.out.txt" "war_and_peace.r.acf" "war_and_peace.r.out.txt" "war_and_peace.r.grep.out.txt" "war_and_peace.s.acf" "war_and_peace.s.out.txt" "war_and_peace.d.acf" "war_and_peace.d.out.txt" "test.aca" "repeated.txt" "repeated.r.acf" "repeated.r.out.txt" "repeated.r.grep.out.txt" "repeated.ri.acf" "repeated.ri.out.txt" "repeated.ri.grep.out.txt" "numbers.p.acf" "numbers.p.out.bin" "numbers.d.acf" "numbers.d.out.bin" "numbers.x.acf" "numbers.x.out.bin" "repeated.aca"
+RMDIR /S /Q "archive.out" "archive.one" "archive.r" "archive.r1"
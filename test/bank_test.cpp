@@ -0,0 +1,90 @@
+/// Round-trip test of context models in a ModelBank with a memory budget.
+/// Order-1, order-2 and order-3 contexts are coded with encodeBlock/decodeBlock,
+/// and the memory used by encoder and decoder banks must stay within the budget.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../src/ac_codec.h"
+
+/// Context of next byte: last 1, 2 or 3 bytes.
+struct NextContext
+{
+    unsigned mask;
+    unsigned operator()(unsigned context, unsigned symbol) const { return ((context << 8) | symbol) & mask; }
+};
+
+bool testBudget(const unsigned char * data, unsigned nb, unsigned order, unsigned budget)
+{
+    NextContext nextContext;
+    nextContext.mask = (1U << (8 * order)) - 1;
+    ModelBank encoderModels(nextContext.mask + 1, 256, budget);
+    ModelBank decoderModels(nextContext.mask + 1, 256, budget);
+
+    /// Code of evicted models may expand the data a little.
+    std::vector<unsigned char> code(2 * nb + 4096);
+    ArithmeticCodec codec(unsigned(code.size()), &code[0]);
+    codec.startEncoder();
+    unsigned context = 0;
+    codec.encodeBlock(data, nb, encoderModels, context, nextContext);
+    unsigned codeBytes = codec.stopEncoder();
+
+    std::vector<unsigned char> decoded(nb);
+    codec.startDecoder();
+    context = 0;
+    codec.decodeBlock(&decoded[0], nb, decoderModels, context, nextContext);
+    codec.stopDecoder();
+
+    if (memcmp(data, &decoded[0], nb) != 0)
+    {
+        printf(" Error: order %u, budget %u: data decoded incorrectly\n", order, budget);
+        return false;
+    }
+    if ((encoderModels.memoryUsage() > budget) || (decoderModels.memoryUsage() > budget))
+    {
+        printf(" Error: order %u, budget %u: %u bytes used\n", order, budget, encoderModels.memoryUsage());
+        return false;
+    }
+
+    printf(" Order %u, budget %8u: %u bytes -> %u bytes, %5u models, %8u bytes used\n",
+           order, budget, nb, codeBytes, encoderModels.activeModels(), encoderModels.memoryUsage());
+    return true;
+}
+
+int main(int numberOfArguments, char * arguments[])
+{
+    if (numberOfArguments != 2)
+    {
+        puts("\n Parameters: BankTest data_file_name");
+        return 1;
+    }
+
+    FILE * dataFile = fopen(arguments[1], "rb");
+    if (dataFile == 0)
+    {
+        puts(" Error: cannot open data file");
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    unsigned char buffer[65536];
+    size_t nb;
+    while ((nb = fread(buffer, 1, sizeof(buffer), dataFile)) != 0) data.insert(data.end(), buffer, buffer + nb);
+    fclose(dataFile);
+
+    unsigned dataBytes = (data.size() > 0x100000 ? 0x100000 : unsigned(data.size()));
+    if (dataBytes == 0)
+    {
+        puts(" Error: empty data file");
+        return 1;
+    }
+
+    const unsigned budgets[] = { 100000, 400000, 1000000, 4000000, 16000000 };
+    for (unsigned order = 1; order <= 3; order++)
+        for (unsigned b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+            if (!testBudget(&data[0], dataBytes, order, budgets[b])) return 1;
+
+    puts(" Bank test passed");
+    return 0;
+}
@@ -0,0 +1,118 @@
+/// Round-trip test of encoder output to a byte sink.
+/// The encoder drains and flushes at random points, and the decoder
+/// calls flushDecoder at the same points.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../src/ac_codec.h"
+
+const unsigned numModels = 16; /// MUST be a power of 2
+const unsigned numRounds = 20;
+
+/// Bytes received by sink.
+void appendBytes(const unsigned char * data, unsigned nb, void * sinkData)
+{
+    std::vector<unsigned char> & code = *static_cast<std::vector<unsigned char> *>(sinkData);
+    code.insert(code.end(), data, data + nb);
+}
+
+/// Same pseudo-random sequence on all platforms.
+unsigned nextRandom(unsigned & seed)
+{
+    seed = seed * 1103515245U + 12345U;
+    return seed >> 16;
+}
+
+bool testRound(const unsigned char * data, unsigned nb, unsigned seed)
+{
+    std::vector<unsigned char> code;
+    std::vector<unsigned> flushPoints;
+    AdaptiveDataModel model[numModels];
+    for (unsigned m = 0; m < numModels; m++) model[m].setAlphabet(256);
+
+    /// Small code buffer, so the encoder also drains by itself.
+    ArithmeticCodec codec(4096);
+    codec.startEncoder(appendBytes, &code);
+    unsigned context = 0, action = seed, sentBytes = 0;
+    for (unsigned k = 0; k < nb; k++)
+    {
+        codec.encode(data[k], model[context]);
+        context = data[k] & (numModels - 1);
+        switch (nextRandom(action) % 1024)
+        {
+            case 0: codec.flushEncoder(); flushPoints.push_back(k + 1); break;
+            case 1: case 2: case 3: sentBytes += codec.drainEncoder(); break;
+        }
+    }
+    unsigned codeBytes = codec.stopEncoder();
+    if ((codeBytes != code.size()) || (sentBytes > codeBytes))
+    {
+        printf(" Error: %u bytes sent to sink, %u reported\n", unsigned(code.size()), codeBytes);
+        return false;
+    }
+
+    /// Decoder reads a few bytes past the end of the code.
+    code.resize(code.size() + 16, 0);
+    ArithmeticCodec decoder(unsigned(code.size()), &code[0]);
+    for (unsigned m = 0; m < numModels; m++) model[m].reset();
+    decoder.startDecoder();
+    context = 0;
+    unsigned nextFlush = 0;
+    for (unsigned k = 0; k < nb; k++)
+    {
+        unsigned byte = decoder.decode(model[context]);
+        if (byte != data[k])
+        {
+            printf(" Error: byte %u decoded incorrectly\n", k);
+            return false;
+        }
+        context = byte & (numModels - 1);
+        if ((nextFlush < flushPoints.size()) && (flushPoints[nextFlush] == k + 1))
+        {
+            decoder.flushDecoder();
+            ++nextFlush;
+        }
+    }
+    decoder.stopDecoder();
+
+    printf(" Round %2u: %u bytes -> %u bytes, %u flush points\n", seed, nb, codeBytes, unsigned(flushPoints.size()));
+    return true;
+}
+
+int main(int numberOfArguments, char * arguments[])
+{
+    if (numberOfArguments != 2)
+    {
+        puts("\n Parameters: SinkTest data_file_name");
+        return 1;
+    }
+
+    FILE * dataFile = fopen(arguments[1], "rb");
+    if (dataFile == 0)
+    {
+        puts(" Error: cannot open data file");
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    unsigned char buffer[65536];
+    size_t nb;
+    while ((nb = fread(buffer, 1, sizeof(buffer), dataFile)) != 0) data.insert(data.end(), buffer, buffer + nb);
+    fclose(dataFile);
+
+    /// Keep each round short; the code must fit in one decoder buffer.
+    unsigned dataBytes = (data.size() > 0x100000 ? 0x100000 : unsigned(data.size()));
+    if (dataBytes == 0)
+    {
+        puts(" Error: empty data file");
+        return 1;
+    }
+
+    for (unsigned round = 1; round <= numRounds; round++)
+        if (!testRound(&data[0], dataBytes, round)) return 1;
+
+    puts(" Sink test passed");
+    return 0;
+}